@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#ifndef CACHEITEMTABLE_P_H
+#define CACHEITEMTABLE_P_H
+
+#include <QVector>
+
+// An open-addressing table mapping quint32 contact ids to cache items.
+
+// Keys are stored with the index of their item in a flat, linearly probed bucket array so a
+// lookup normally touches a single cache line.  Items are allocated in fixed size chunks which
+// are never moved or reallocated, so a pointer to an item remains valid until that item is
+// erased, however many items are subsequently inserted.  Storage of erased items is reused.
+
+template <typename T>
+class CacheItemTable
+{
+    struct Bucket
+    {
+        quint32 key;
+        int slot;
+    };
+
+    enum {
+        ChunkShift = 8,
+        ChunkSize = 1 << ChunkShift,
+        MinimumBucketCount = 64
+    };
+
+public:
+    class const_iterator;
+
+    class iterator
+    {
+    public:
+        iterator() : table(0), bucket(0) {}
+
+        quint32 key() const { return table->m_buckets.at(bucket).key; }
+        T &value() const { return table->item(table->m_buckets.at(bucket).slot); }
+        T &operator *() const { return value(); }
+        T *operator ->() const { return &value(); }
+
+        iterator &operator ++() { bucket = table->nextBucket(bucket + 1); return *this; }
+
+        bool operator ==(const iterator &other) const { return bucket == other.bucket; }
+        bool operator !=(const iterator &other) const { return bucket != other.bucket; }
+
+    private:
+        friend class CacheItemTable;
+        friend class const_iterator;
+
+        iterator(CacheItemTable *table, int bucket) : table(table), bucket(bucket) {}
+
+        CacheItemTable *table;
+        int bucket;
+    };
+
+    class const_iterator
+    {
+    public:
+        const_iterator() : table(0), bucket(0) {}
+        const_iterator(const iterator &it) : table(it.table), bucket(it.bucket) {}
+
+        quint32 key() const { return table->m_buckets.at(bucket).key; }
+        const T &value() const { return table->item(table->m_buckets.at(bucket).slot); }
+        const T &operator *() const { return value(); }
+        const T *operator ->() const { return &value(); }
+
+        const_iterator &operator ++() { bucket = table->nextBucket(bucket + 1); return *this; }
+
+        bool operator ==(const const_iterator &other) const { return bucket == other.bucket; }
+        bool operator !=(const const_iterator &other) const { return bucket != other.bucket; }
+
+    private:
+        friend class CacheItemTable;
+
+        const_iterator(const CacheItemTable *table, int bucket) : table(table), bucket(bucket) {}
+
+        const CacheItemTable *table;
+        int bucket;
+    };
+
+    CacheItemTable()
+        : m_count(0), m_slotCount(0), m_shift(32)
+    {
+    }
+
+    CacheItemTable(const CacheItemTable &other)
+        : m_count(0), m_slotCount(0), m_shift(32)
+    {
+        copy(other);
+    }
+
+    ~CacheItemTable()
+    {
+        deleteChunks();
+    }
+
+    CacheItemTable &operator =(const CacheItemTable &other)
+    {
+        if (&other != this) {
+            clear();
+            copy(other);
+        }
+        return *this;
+    }
+
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+
+    qint64 allocatedBytes() const
+    {
+        return qint64(m_buckets.capacity()) * sizeof(Bucket)
+                + qint64(m_chunks.count()) * ChunkSize * sizeof(T)
+                + qint64(m_chunks.capacity()) * sizeof(T *)
+                + qint64(m_freeSlots.capacity()) * sizeof(int);
+    }
+
+    void clear()
+    {
+        deleteChunks();
+        m_chunks.clear();
+        m_buckets.clear();
+        m_freeSlots.clear();
+        m_count = 0;
+        m_slotCount = 0;
+        m_shift = 32;
+    }
+
+    void reserve(int count)
+    {
+        if (count * 2 > m_buckets.count())
+            rehash(count * 2);
+    }
+
+    iterator begin() { return iterator(this, nextBucket(0)); }
+    iterator end() { return iterator(this, m_buckets.count()); }
+    const_iterator begin() const { return const_iterator(this, nextBucket(0)); }
+    const_iterator end() const { return const_iterator(this, m_buckets.count()); }
+    const_iterator constBegin() const { return begin(); }
+    const_iterator constEnd() const { return end(); }
+
+    iterator find(quint32 key) { return iterator(this, findBucket(key)); }
+    const_iterator find(quint32 key) const { return const_iterator(this, findBucket(key)); }
+    const_iterator constFind(quint32 key) const { return find(key); }
+
+    bool contains(quint32 key) const { return findBucket(key) != m_buckets.count(); }
+
+    T &operator [](quint32 key)
+    {
+        const int bucket = findBucket(key);
+        if (bucket != m_buckets.count())
+            return item(m_buckets.at(bucket).slot);
+
+        return item(insertKey(key));
+    }
+
+    iterator insert(quint32 key, const T &value)
+    {
+        int bucket = findBucket(key);
+        if (bucket == m_buckets.count()) {
+            insertKey(key);
+            bucket = findBucket(key);
+        }
+        item(m_buckets.at(bucket).slot) = value;
+        return iterator(this, bucket);
+    }
+
+    void erase(iterator it)
+    {
+        Bucket *buckets = m_buckets.data();
+        const int mask = m_buckets.count() - 1;
+
+        // Release anything held by the item, and make its storage available for reuse.
+        const int slot = buckets[it.bucket].slot;
+        item(slot) = T();
+        m_freeSlots.append(slot);
+        --m_count;
+
+        // Shift any following entries displaced past the erased bucket back, so that no probe
+        // sequence is interrupted by the now empty bucket.
+        int i = it.bucket;
+        for (int j = (i + 1) & mask; buckets[j].slot != -1; j = (j + 1) & mask) {
+            const int home = homeBucket(buckets[j].key);
+            const bool reachable = i <= j
+                    ? (home <= i || home > j)
+                    : (home <= i && home > j);
+            if (reachable) {
+                buckets[i] = buckets[j];
+                i = j;
+            }
+        }
+        buckets[i].slot = -1;
+    }
+
+    int remove(quint32 key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+private:
+    T &item(int slot) { return m_chunks.at(slot >> ChunkShift)[slot & (ChunkSize - 1)]; }
+    const T &item(int slot) const { return m_chunks.at(slot >> ChunkShift)[slot & (ChunkSize - 1)]; }
+
+    int homeBucket(quint32 key) const
+    {
+        // Fibonacci hashing; spreads the small sequential ids allocated by the backend evenly
+        // across the table.
+        return m_shift < 32 ? int((key * 2654435769u) >> m_shift) : 0;
+    }
+
+    int findBucket(quint32 key) const
+    {
+        const int bucketCount = m_buckets.count();
+        if (bucketCount == 0)
+            return 0;
+
+        const Bucket *buckets = m_buckets.constData();
+        const int mask = bucketCount - 1;
+        for (int i = homeBucket(key); buckets[i].slot != -1; i = (i + 1) & mask) {
+            if (buckets[i].key == key)
+                return i;
+        }
+        return bucketCount;
+    }
+
+    int nextBucket(int bucket) const
+    {
+        const int bucketCount = m_buckets.count();
+        while (bucket < bucketCount && m_buckets.at(bucket).slot == -1)
+            ++bucket;
+        return bucket;
+    }
+
+    int allocateSlot()
+    {
+        if (!m_freeSlots.isEmpty()) {
+            const int slot = m_freeSlots.last();
+            m_freeSlots.resize(m_freeSlots.count() - 1);
+            return slot;
+        }
+
+        if (m_slotCount == m_chunks.count() * ChunkSize)
+            m_chunks.append(new T[ChunkSize]);
+        return m_slotCount++;
+    }
+
+    int insertKey(quint32 key)
+    {
+        // Keep the load factor at or below one half so probe sequences remain short.
+        if ((m_count + 1) * 2 > m_buckets.count())
+            rehash((m_count + 1) * 2);
+
+        const int slot = allocateSlot();
+        placeKey(key, slot);
+        ++m_count;
+        return slot;
+    }
+
+    void placeKey(quint32 key, int slot)
+    {
+        Bucket *buckets = m_buckets.data();
+        const int mask = m_buckets.count() - 1;
+
+        int i = homeBucket(key);
+        while (buckets[i].slot != -1)
+            i = (i + 1) & mask;
+
+        buckets[i].key = key;
+        buckets[i].slot = slot;
+    }
+
+    void rehash(int minimumCount)
+    {
+        int bucketCount = MinimumBucketCount;
+        int shift = 32 - 6;
+        while (bucketCount < minimumCount) {
+            bucketCount <<= 1;
+            --shift;
+        }
+        if (bucketCount <= m_buckets.count())
+            return;
+
+        // Only the keys move; items stay where they are.
+        const QVector<Bucket> buckets = m_buckets;
+
+        Bucket empty;
+        empty.key = 0;
+        empty.slot = -1;
+        m_buckets.fill(empty, bucketCount);
+        m_shift = shift;
+
+        for (int i = 0; i < buckets.count(); ++i) {
+            if (buckets.at(i).slot != -1)
+                placeKey(buckets.at(i).key, buckets.at(i).slot);
+        }
+    }
+
+    void deleteChunks()
+    {
+        for (int i = 0; i < m_chunks.count(); ++i)
+            delete [] m_chunks.at(i);
+    }
+
+    void copy(const CacheItemTable &other)
+    {
+        reserve(other.count());
+        for (const_iterator it = other.begin(); it != other.end(); ++it)
+            (*this)[it.key()] = *it;
+    }
+
+    QVector<Bucket> m_buckets;
+    QVector<T *> m_chunks;
+    QVector<int> m_freeSlots;
+    int m_count;
+    int m_slotCount;
+    int m_shift;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include "contactrecord_p.h"
+
+#include "seasidecache.h"
+#include "normalization_p.h"
+
+#include <QContactAvatar>
+#include <QContactFavorite>
+#include <QContactGlobalPresence>
+#include <QContactName>
+#include <QContactPhoneNumber>
+
+namespace ContactRecords {
+
+ContactRecord prepare(const QContact &contact, SeasideFilteredModel::DisplayLabelOrder order)
+{
+    const QContactName name = contact.detail<QContactName>();
+
+    ContactRecord record;
+    record.contact = contact;
+    record.id = SeasideFilteredModel::apiId(contact);
+    record.iid = SeasideFilteredModel::internalId(contact);
+    record.firstName = name.firstName();
+    record.lastName = name.lastName();
+#ifdef USING_QTPIM
+    record.displayLabel = name.value<QString>(QContactName__FieldCustomLabel);
+#else
+    record.displayLabel = name.customLabel();
+#endif
+    record.avatarUrl = contact.detail<QContactAvatar>().imageUrl();
+    record.favorite = contact.detail<QContactFavorite>().isFavorite();
+    record.presenceState = contact.detail<QContactGlobalPresence>().presenceState();
+    record.nameGroup = SeasideCache::determineNameGroup(contact, order);
+
+    // The contact details may not be retained, so the search tokens must be extracted now.
+    record.filterKey = SeasideFilteredModel::filterKey(contact);
+
+    foreach (const QContactPhoneNumber &phoneNumber, contact.details<QContactPhoneNumber>())
+        record.phoneNumbers.append(Normalization::normalizePhoneNumber(phoneNumber.number()));
+
+    return record;
+}
+
+QList<ContactRecord> prepare(const QList<QContact> &contacts, SeasideFilteredModel::DisplayLabelOrder order)
+{
+    QList<ContactRecord> records;
+    records.reserve(contacts.count());
+    foreach (const QContact &contact, contacts)
+        records.append(prepare(contact, order));
+    return records;
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CONTACTRECORD_P_H
+#define CONTACTRECORD_P_H
+
+#include <QContact>
+#include <QContactPresence>
+#include <QList>
+#include <QStringList>
+#include <QUrl>
+
+#include "seasidefilteredmodel.h"
+
+USE_CONTACTS_NAMESPACE
+
+// A fetched contact reduced to the values the cache retains for it.  Records are prepared
+// away from the GUI thread; only interning the strings and inserting them into the cache
+// remain to be done there.
+
+struct ContactRecord
+{
+    ContactRecord()
+        : iid(0)
+        , presenceState(QContactPresence::PresenceUnknown)
+        , favorite(false)
+    {}
+
+    QContact contact;
+    SeasideFilteredModel::ContactIdType id;
+    quint32 iid;
+    QString firstName;
+    QString lastName;
+    QString displayLabel;
+    QUrl avatarUrl;
+    QChar nameGroup;
+    QContactPresence::PresenceState presenceState;
+    bool favorite;
+    QStringList filterKey;
+    QStringList phoneNumbers;   // Normalized.
+};
+
+namespace ContactRecords {
+
+ContactRecord prepare(const QContact &contact, SeasideFilteredModel::DisplayLabelOrder order);
+QList<ContactRecord> prepare(const QList<QContact> &contacts, SeasideFilteredModel::DisplayLabelOrder order);
+
+}
+
+#endif
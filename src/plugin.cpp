@@ -44,6 +44,7 @@
 #include "seasideperson.h"
 #include "seasidefilteredmodel.h"
 #include "seasidenamegroupmodel.h"
+#include "seasidecachediagnostics.h"
 
 class Q_DECL_EXPORT NemoContactsPlugin : public QDeclarativeExtensionPlugin
 {
@@ -69,6 +70,7 @@ public:
         qmlRegisterType<SeasideNameGroupModel>(uri, 1, 0, "PeopleNameGroupModel");
         qmlRegisterType<SeasidePersonAttached>();
         qmlRegisterType<SeasidePerson>(uri, 1, 0, "Person");
+        qmlRegisterType<SeasideCacheDiagnostics>(uri, 1, 0, "PeopleCacheDiagnostics");
     }
 };
 
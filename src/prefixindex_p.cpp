@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+
+#include "prefixindex_p.h"
+
+PrefixIndex::PrefixIndex()
+    : m_postingCount(0)
+{
+}
+
+// A key may hold tokens which differ only in case, which are indexed once.
+static QSet<QString> foldedTokens(const QStringList &tokens)
+{
+    QSet<QString> folded;
+    foreach (const QString &token, tokens)
+        folded.insert(token.toCaseFolded());
+    return folded;
+}
+
+void PrefixIndex::insert(quint32 iid, const QStringList &tokens)
+{
+    foreach (const QString &token, foldedTokens(tokens)) {
+        QSet<quint32> &iids = m_postings[token];
+        const int count = iids.count();
+        iids.insert(iid);
+        m_postingCount += iids.count() - count;
+    }
+}
+
+void PrefixIndex::remove(quint32 iid, const QStringList &tokens)
+{
+    foreach (const QString &token, foldedTokens(tokens)) {
+        QMap<QString, QSet<quint32> >::iterator it = m_postings.find(token);
+        if (it == m_postings.end() || !it->remove(iid))
+            continue;
+
+        --m_postingCount;
+        if (it->isEmpty())
+            m_postings.erase(it);
+    }
+}
+
+void PrefixIndex::clear()
+{
+    m_postings.clear();
+    m_postingCount = 0;
+}
+
+QSet<quint32> PrefixIndex::match(const QStringList &prefixes) const
+{
+    QSet<quint32> iids;
+    for (int i = 0; i < prefixes.count(); ++i) {
+        if (i == 0) {
+            iids = match(prefixes.at(i));
+        } else if (!iids.isEmpty()) {
+            iids.intersect(match(prefixes.at(i)));
+        }
+    }
+    return iids;
+}
+
+QSet<quint32> PrefixIndex::match(const QString &prefix) const
+{
+    const QString foldedPrefix = prefix.toCaseFolded();
+
+    // The tokens starting with the prefix are ordered together, from the prefix itself.
+    QSet<quint32> iids;
+    QMap<QString, QSet<quint32> >::const_iterator it = m_postings.lowerBound(foldedPrefix);
+    for (; it != m_postings.constEnd() && it.key().startsWith(foldedPrefix); ++it)
+        iids.unite(*it);
+    return iids;
+}
+
+int PrefixIndex::count() const
+{
+    return m_postings.count();
+}
+
+qint64 PrefixIndex::size() const
+{
+    // Each posting is a hash node of the contact's id.
+    qint64 size = qint64(m_postingCount) * (sizeof(void *) + sizeof(uint) + sizeof(quint32));
+    for (QMap<QString, QSet<quint32> >::const_iterator it = m_postings.constBegin();
+            it != m_postings.constEnd(); ++it) {
+        size += qint64(it.key().size()) * sizeof(QChar) + sizeof(QString) + sizeof(QSet<quint32>)
+                + qint64(it->capacity()) * sizeof(void *);
+    }
+    return size;
+}
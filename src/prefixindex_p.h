@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+
+#ifndef PREFIXINDEX_P_H
+#define PREFIXINDEX_P_H
+
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+
+// Maps the tokens of contacts' filter keys to the contacts containing them, so the contacts
+// with a token starting with some prefix are found without visiting every contact.  Tokens
+// are matched insensitive to case, as they are by SeasideFilteredModel::filterId().
+
+class PrefixIndex
+{
+public:
+    PrefixIndex();
+
+    void insert(quint32 iid, const QStringList &tokens);
+    void remove(quint32 iid, const QStringList &tokens);
+    void clear();
+
+    // Returns the contacts with a token starting with each of the prefixes.
+    QSet<quint32> match(const QStringList &prefixes) const;
+
+    int count() const;
+    qint64 size() const;
+
+private:
+    QSet<quint32> match(const QString &prefix) const;
+
+    QMap<QString, QSet<quint32> > m_postings;
+    int m_postingCount;
+};
+
+#endif
@@ -33,24 +33,33 @@
 
 #include "seasideperson.h"
 #include "normalization_p.h"
-#include "synchronizelists_p.h"
 #include "constants_p.h"
 
 #include <QCoreApplication>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+#include <QtConcurrent/QtConcurrentRun>
+#else
+#include <QtConcurrentRun>
+#endif
 #ifdef USING_QTPIM
 #include <QStandardPaths>
 #else
 #include <QDesktopServices>
 #endif
+#include <QDataStream>
 #include <QDir>
 #include <QEvent>
 #include <QFile>
+#include <QFileInfo>
+#include <QImage>
 
 #include <QContactAvatar>
+#include <QContactChangeLogFilter>
 #include <QContactDetailFilter>
 #include <QContactEmailAddress>
 #include <QContactFavorite>
 #include <QContactName>
+#include <QContactNickname>
 #include <QContactOnlineAccount>
 #include <QContactOrganization>
 #include <QContactPhoneNumber>
@@ -64,6 +73,11 @@
 
 #include <QtDebug>
 
+#include <cstdio>
+#include <algorithm>
+
+#include <sys/stat.h>
+
 USE_VERSIT_NAMESPACE
 
 static QList<QChar> getAllContactNameGroups()
@@ -103,6 +117,32 @@ static QList<QChar> getAllContactNameGroups()
 }
 
 SeasideCache *SeasideCache::instance = 0;
+
+// Counts of cache lookups and their outcomes, retained for the life of the process.
+struct LookupStatistics
+{
+    quint64 cacheItemHits;
+    quint64 cacheItemMisses;
+    quint64 personHits;
+    quint64 placeholdersCreated;
+    quint64 completeContactFetches;
+    quint64 phoneNumbersResolved;
+    quint64 phoneNumbersUnresolved;
+};
+
+static LookupStatistics lookupCounts = { 0, 0, 0, 0, 0, 0, 0 };
+
+struct CoalescingStatistics
+{
+    quint64 notifications;
+    quint64 contactsReported;
+    quint64 duplicatesDropped;
+    quint64 immediateFetches;
+    quint64 postponedFetches;
+    quint64 largestFetch;
+};
+
+static CoalescingStatistics coalescingCounts = { 0, 0, 0, 0, 0, 0 };
 QList<QChar> SeasideCache::allContactNameGroups = getAllContactNameGroups();
 
 static QString managerName()
@@ -117,6 +157,235 @@ static QString managerName()
             : QString();
 }
 
+// Identifies the cache snapshot file format; the version must be incremented whenever the
+// content written by snapshotData() changes.
+static const quint32 SnapshotMagic = 0x4e435353;   // 'NCSS'
+static const quint32 SnapshotVersion = 2;
+
+// magic, version, checksum and payload size.
+static const int SnapshotHeaderSize = 4 + 4 + 2 + 4;
+
+// The lists stored in a snapshot, in order.
+static const SeasideFilteredModel::FilterType snapshotFilters[] = {
+    SeasideFilteredModel::FilterAll,
+    SeasideFilteredModel::FilterFavorites,
+    SeasideFilteredModel::FilterOnline
+};
+
+// The lists populated by an initial query, in the order they are reported as populated.
+static const SeasideFilteredModel::FilterType populationFilters[] = {
+    SeasideFilteredModel::FilterFavorites,
+    SeasideFilteredModel::FilterOnline,
+    SeasideFilteredModel::FilterAll
+};
+
+static const int populationFilterCount = sizeof(populationFilters) / sizeof(populationFilters[0]);
+
+static QContactFilter populationFilter(SeasideFilteredModel::FilterType filter)
+{
+    if (filter == SeasideFilteredModel::FilterFavorites)
+        return QContactFavorite::match();
+    if (filter == SeasideFilteredModel::FilterOnline)
+        return QContactGlobalPresence::match(QContactPresence::PresenceAvailable);
+    return QContactFilter();
+}
+
+// The lists maintained from the content of the all list rather than by a query of their own.
+// They are queried only to populate them ahead of the all list.
+static const SeasideFilteredModel::FilterType derivedFilters[] = {
+    SeasideFilteredModel::FilterFavorites,
+    SeasideFilteredModel::FilterOnline
+};
+
+static const int derivedFilterCount = sizeof(derivedFilters) / sizeof(derivedFilters[0]);
+
+static bool isDerivedMember(SeasideFilteredModel::FilterType filter, const SeasideCacheItem &item)
+{
+    if (filter == SeasideFilteredModel::FilterFavorites)
+        return item.favorite;
+    return item.presenceState == QContactPresence::PresenceAvailable;
+}
+
+static bool fetchProfilesEnabled()
+{
+    // Fetching every detail for every purpose can be restored for comparison.
+    return qgetenv("NEMO_CONTACT_FETCH_PROFILES") != "0";
+}
+
+static QContactFetchHint listFetchHint()
+{
+    QContactFetchHint fetchHint;
+    fetchHint.setOptimizationHints(QContactFetchHint::NoRelationships
+            | QContactFetchHint::NoActionPreferences
+            | QContactFetchHint::NoBinaryBlobs);
+
+    // The details of the summary and the phone number index, and those searched by the
+    // filter key.
+#ifdef USING_QTPIM
+    fetchHint.setDetailTypesHint(QList<QContactDetail::DetailType>()
+            << QContactName::Type
+            << QContactNickname::Type
+            << QContactAvatar::Type
+            << QContactFavorite::Type
+            << QContactPhoneNumber::Type
+            << QContactEmailAddress::Type
+            << QContactOrganization::Type
+            << QContactOnlineAccount::Type
+            << QContactGlobalPresence::Type
+            << QContactPresence::Type);
+#else
+    fetchHint.setDetailDefinitionsHint(QStringList()
+            << QContactName::DefinitionName
+            << QContactNickname::DefinitionName
+            << QContactAvatar::DefinitionName
+            << QContactFavorite::DefinitionName
+            << QContactPhoneNumber::DefinitionName
+            << QContactEmailAddress::DefinitionName
+            << QContactOrganization::DefinitionName
+            << QContactOnlineAccount::DefinitionName
+            << QContactGlobalPresence::DefinitionName
+            << QContactPresence::DefinitionName);
+#endif
+
+    return fetchHint;
+}
+
+static int populationBudget()
+{
+    // Time spent inserting initial results on each pass through the event loop.
+    static const int DefaultPopulationBudgetMs = 8;
+
+    bool ok = false;
+    const int budget = qgetenv("NEMO_CONTACT_POPULATION_BUDGET").toInt(&ok);
+    return ok && budget > 0 ? budget : DefaultPopulationBudgetMs;
+}
+
+static bool processInBackground()
+{
+    // Fetched contacts can instead be prepared on the GUI thread, as they are received.
+    return qgetenv("NEMO_CONTACT_BACKGROUND_PROCESSING") != "0";
+}
+
+static int populationPageSize()
+{
+    // Contacts fetched in each page of a paged list; the ids of all contacts in the list
+    // are fetched first.  Zero fetches the list in a single query.
+    static const int DefaultPageSize = 50;
+
+    bool ok = false;
+    const int size = qgetenv("NEMO_CONTACT_PAGE_SIZE").toInt(&ok);
+    return ok && size >= 0 ? size : DefaultPageSize;
+}
+
+static int maxActiveRequests()
+{
+    // Requests of different types which may be active at the same time.
+    static const int DefaultMaxActiveRequests = 3;
+
+    bool ok = false;
+    const int count = qgetenv("NEMO_CONTACT_MAX_REQUESTS").toInt(&ok);
+    return ok && count > 0 ? count : DefaultMaxActiveRequests;
+}
+
+static int completeContactBudget()
+{
+    // Complete contacts not held by a person are dropped back to their summary, least
+    // recently used first, once they are estimated to occupy more than this many bytes.
+    static const int DefaultCompleteContactBudget = 512 * 1024;
+
+    bool ok = false;
+    const int budget = qgetenv("NEMO_CONTACT_COMPLETE_BYTES").toInt(&ok);
+    return ok && budget >= 0 ? budget : DefaultCompleteContactBudget;
+}
+
+static int estimatedSize(const QContact &contact)
+{
+    // Allocations for each detail and each of its values, besides the content of the values.
+    static const int DetailOverhead = 64;
+    static const int ValueOverhead = 32;
+
+    int size = sizeof(QContact);
+    foreach (const QContactDetail &detail, contact.details()) {
+        size += DetailOverhead;
+#ifdef USING_QTPIM
+        const QList<QVariant> values = detail.values().values();
+#else
+        const QList<QVariant> values = detail.variantValues().values();
+#endif
+        foreach (const QVariant &value, values) {
+            size += ValueOverhead;
+            switch (value.type()) {
+            case QVariant::String:
+                size += value.toString().size() * sizeof(QChar);
+                break;
+            case QVariant::StringList:
+                foreach (const QString &string, value.toStringList())
+                    size += ValueOverhead + string.size() * sizeof(QChar);
+                break;
+            case QVariant::ByteArray:
+                size += value.toByteArray().size();
+                break;
+            case QVariant::Image:
+                size += value.value<QImage>().byteCount();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return size;
+}
+
+static QString snapshotPath()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    const QString baseDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+#else
+    const QString baseDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    return baseDir + QLatin1String("/nemo-qml-plugin-contacts/cache.snapshot");
+}
+
+static QString backendDatabasePath()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+#else
+    const QString dataDir = QDir::homePath() + QLatin1String("/.local/share");
+#endif
+    // The backend uses the privileged database where the process may access it.
+    const QString privilegedPath = dataDir + QLatin1String("/system/privileged/Contacts/qtcontacts-sqlite/contacts.db");
+    if (QFile::exists(privilegedPath))
+        return privilegedPath;
+    return dataDir + QLatin1String("/system/Contacts/qtcontacts-sqlite/contacts.db");
+}
+
+// Identifies the database a snapshot was taken from, and the state it was in; zero where the
+// storage of the backend is not known.
+struct BackendState
+{
+    BackendState() : device(0), inode(0), modified(0) {}
+
+    quint64 device;
+    quint64 inode;
+    qint64 modified;
+};
+
+static BackendState backendState(const QString &managerName)
+{
+    BackendState state;
+    if (managerName != QLatin1String("org.nemomobile.contacts.sqlite"))
+        return state;
+
+    struct stat info;
+    if (::stat(QFile::encodeName(backendDatabasePath()).constData(), &info) == 0) {
+        state.device = info.st_dev;
+        state.inode = info.st_ino;
+        state.modified = info.st_mtime;
+    }
+    return state;
+}
+
 template<typename T, typename Filter, typename Field>
 void setDetailType(Filter &filter, Field field)
 {
@@ -127,21 +396,37 @@ void setDetailType(Filter &filter, Field field)
 #endif
 }
 
+static QContactFilter aggregateFilter()
+{
+    // Only aggregate contacts are listed; constituents are fetched on demand.
+    QContactDetailFilter filter;
+    setDetailType<QContactSyncTarget>(filter, QContactSyncTarget::FieldSyncTarget);
+    filter.setValue("aggregate");
+    return filter;
+}
+
 SeasideCache::SeasideCache()
     : m_manager(managerName())
 #ifdef HAS_MLITE
     , m_displayLabelOrderConf(QLatin1String("/org/nemomobile/contacts/display_label_order"))
 #endif
-    , m_resultsRead(0)
+    , m_maxActiveRequests(maxActiveRequests())
+    , m_postponementInterval(0)
     , m_populated(0)
     , m_cacheIndex(0)
     , m_queryIndex(0)
-    , m_appendIndex(0)
-    , m_fetchFilter(SeasideFilteredModel::FilterFavorites)
+    , m_populationBudget(populationBudget())
+    , m_pageSize(populationPageSize())
+    , m_completeContactBudget(completeContactBudget())
+    , m_completeContactBytes(0)
+    , m_fetchFilter(SeasideFilteredModel::FilterNone)
+    , m_fetchProfile(ListProfile)
     , m_displayLabelOrder(SeasideFilteredModel::FirstNameFirst)
     , m_updatesPending(true)
     , m_refreshRequired(false)
     , m_contactsUpdated(false)
+    , m_fetchingDelta(false)
+    , m_processInBackground(processInBackground())
 {
     Q_ASSERT(!instance);
     instance = this;
@@ -174,16 +459,28 @@ SeasideCache::SeasideCache()
 #endif
 
     connect(&m_fetchRequest, SIGNAL(resultsAvailable()), this, SLOT(contactsAvailable()));
+    connect(&m_completionRequest, SIGNAL(resultsAvailable()), this, SLOT(contactsAvailable()));
+    for (int i = 0; i < populationFilterCount; ++i) {
+        QContactFetchRequest *request = &m_populationStages[populationFilters[i]].request;
+        connect(request, SIGNAL(resultsAvailable()), this, SLOT(contactsAvailable()));
+        connect(request, SIGNAL(stateChanged(QContactAbstractRequest::State)),
+                this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
+        request->setManager(&m_manager);
+    }
     connect(&m_fetchByIdRequest, SIGNAL(resultsAvailable()), this, SLOT(contactsAvailable()));
     connect(&m_contactIdRequest, SIGNAL(resultsAvailable()), this, SLOT(contactIdsAvailable()));
     connect(&m_relationshipsFetchRequest, SIGNAL(resultsAvailable()), this, SLOT(relationshipsAvailable()));
 
     connect(&m_fetchRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
             this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
+    connect(&m_completionRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
+            this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
     connect(&m_fetchByIdRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
             this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
     connect(&m_contactIdRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
             this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
+    connect(&m_removedIdRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
+            this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
     connect(&m_relationshipsFetchRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
             this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
     connect(&m_removeRequest, SIGNAL(stateChanged(QContactAbstractRequest::State)),
@@ -192,31 +489,14 @@ SeasideCache::SeasideCache()
             this, SLOT(requestStateChanged(QContactAbstractRequest::State)));
 
     m_fetchRequest.setManager(&m_manager);
+    m_completionRequest.setManager(&m_manager);
     m_fetchByIdRequest.setManager(&m_manager);
     m_contactIdRequest.setManager(&m_manager);
+    m_removedIdRequest.setManager(&m_manager);
     m_relationshipsFetchRequest.setManager(&m_manager);
     m_removeRequest.setManager(&m_manager);
     m_saveRequest.setManager(&m_manager);
 
-    QContactFetchHint fetchHint;
-    fetchHint.setOptimizationHints(QContactFetchHint::NoRelationships
-            | QContactFetchHint::NoActionPreferences
-            | QContactFetchHint::NoBinaryBlobs);
-
-    /* Possibly too aggressive - this filters out details we may need, such as nickname.
-       Remove until performance testing indicates it is worthwhile.
-    fetchHint.setDetailDefinitionsHint(QStringList()
-            << QContactName::DefinitionName
-            << QContactAvatar::DefinitionName
-            << QContactPhoneNumber::DefinitionName
-            << QContactEmailAddress::DefinitionName
-            << QContactOrganization::DefinitionName
-            << QContactOnlineAccount::DefinitionName);
-    */
-
-    m_fetchRequest.setFetchHint(fetchHint);
-    m_fetchRequest.setFilter(QContactFavorite::match());
-
     QContactSortOrder firstLabelOrder;
     setDetailType<QContactName>(firstLabelOrder, QContactName::FieldFirstName);
     firstLabelOrder.setCaseSensitivity(Qt::CaseInsensitive);
@@ -235,12 +515,38 @@ SeasideCache::SeasideCache()
 
     m_fetchRequest.setSorting(sorting);
     m_contactIdRequest.setSorting(sorting);
-
-    m_fetchRequest.start();
+    for (int i = 0; i < populationFilterCount; ++i)
+        m_populationStages[populationFilters[i]].request.setSorting(sorting);
+
+    // Each process holds its own cache.  Sharing one between processes would only save memory
+    // if the lists and summaries were used in place, but the models hold them as QStrings and
+    // table items; the snapshot instead spares each process from populating the cache anew.
+    if (loadSnapshot()) {
+        qDebug() << "Snapshot restored in" << m_timer.elapsed() << "ms";
+
+        makePopulated(SeasideFilteredModel::FilterNone);
+        makePopulated(SeasideFilteredModel::FilterAll);
+        makePopulated(SeasideFilteredModel::FilterFavorites);
+        makePopulated(SeasideFilteredModel::FilterOnline);
+
+        // Reconcile the restored lists with the backend, the contacts changed since the
+        // snapshot was written are fetched alongside.
+        m_refreshRequired = true;
+        m_updatesPending = false;
+        requestUpdate();
+    } else {
+        startPopulation();
+    }
 }
 
 SeasideCache::~SeasideCache()
 {
+    // Any snapshot being written is completed before the changes made since are written.
+    m_snapshotWrite.waitForFinished();
+    if (m_snapshotTimer.isActive())
+        writeSnapshot();
+    m_snapshotWrite.waitForFinished();
+
     if (instance == this)
         instance = 0;
 }
@@ -314,11 +620,28 @@ QChar SeasideCache::nameGroupForCacheItem(SeasideCacheItem *cacheItem)
     if (!cacheItem)
         return QChar();
 
+    return cacheItem->nameGroup;
+}
+
+QChar SeasideCache::determineNameGroup(const SeasideCacheItem &item, const QContact &contact)
+{
+    return determineNameGroup(
+            contact,
+            displayLabelOrder(),
+            item.person ? item.person->displayLabel() : QString());
+}
+
+QChar SeasideCache::determineNameGroup(
+        const QContact &contact,
+        SeasideFilteredModel::DisplayLabelOrder order,
+        const QString &personDisplayLabel)
+{
+    // This may be called away from the GUI thread, and so must not refer to the cache instance.
     QChar group;
     QString first;
     QString last;
-    QContactName nameDetail = cacheItem->contact.detail<QContactName>();
-    if (SeasideCache::displayLabelOrder() == SeasideFilteredModel::FirstNameFirst) {
+    QContactName nameDetail = contact.detail<QContactName>();
+    if (order == SeasideFilteredModel::FirstNameFirst) {
         first = nameDetail.firstName();
         last = nameDetail.lastName();
     } else {
@@ -330,9 +653,9 @@ QChar SeasideCache::nameGroupForCacheItem(SeasideCacheItem *cacheItem)
     } else if (!last.isEmpty()) {
         group = last[0].toUpper();
     } else {
-        QString displayLabel = (cacheItem->person)
-                ? cacheItem->person->displayLabel()
-                : SeasidePerson::generateDisplayLabel(cacheItem->contact);
+        QString displayLabel = !personDisplayLabel.isNull()
+                ? personDisplayLabel
+                : SeasidePerson::generateDisplayLabel(contact);
         if (!displayLabel.isEmpty())
             group = displayLabel[0].toUpper();
     }
@@ -340,7 +663,7 @@ QChar SeasideCache::nameGroupForCacheItem(SeasideCacheItem *cacheItem)
     // XXX temporary workaround for non-latin names: use non-name details to try to find a
     // latin character group
     if (!group.isNull() && group.toLatin1() != group) {
-        QString displayLabel = SeasidePerson::generateDisplayLabelFromNonNameDetails(cacheItem->contact);
+        QString displayLabel = SeasidePerson::generateDisplayLabelFromNonNameDetails(contact);
         if (!displayLabel.isEmpty())
             group = displayLabel[0].toUpper();
     }
@@ -351,6 +674,129 @@ QChar SeasideCache::nameGroupForCacheItem(SeasideCacheItem *cacheItem)
     return group;
 }
 
+QContact SeasideCache::summaryContact(const SeasideCacheItem &item)
+{
+    QContact contact;
+#ifdef USING_QTPIM
+    contact.setId(item.id);
+#else
+    QContactId contactId;
+    contactId.setLocalId(item.id);
+    contact.setId(contactId);
+#endif
+
+    if (!item.firstName.isEmpty() || !item.lastName.isEmpty() || !item.displayLabel.isNull()) {
+        QContactName name;
+        if (!item.firstName.isEmpty())
+            name.setFirstName(item.firstName);
+        if (!item.lastName.isEmpty())
+            name.setLastName(item.lastName);
+        if (!item.displayLabel.isNull()) {
+#ifdef USING_QTPIM
+            name.setValue(QContactName__FieldCustomLabel, item.displayLabel);
+#else
+            name.setCustomLabel(item.displayLabel);
+#endif
+        }
+        contact.saveDetail(&name);
+    }
+
+    if (!item.avatarUrl.isEmpty()) {
+        QContactAvatar avatar;
+        avatar.setImageUrl(item.avatarUrl);
+        contact.saveDetail(&avatar);
+    }
+
+    if (item.favorite) {
+        QContactFavorite favorite;
+        favorite.setFavorite(true);
+        contact.saveDetail(&favorite);
+    }
+
+    if (item.presenceState != QContactPresence::PresenceUnknown) {
+        QContactGlobalPresence presence;
+        presence.setPresenceState(item.presenceState);
+        contact.saveDetail(&presence);
+    }
+
+    return contact;
+}
+
+void SeasideCache::updateSummary(SeasideCacheItem *item, const ContactRecord &record)
+{
+    item->id = record.id;
+    item->firstName = m_stringPool.intern(record.firstName);
+    item->lastName = m_stringPool.intern(record.lastName);
+    item->displayLabel = m_stringPool.intern(record.displayLabel);
+    item->avatarUrl = record.avatarUrl;
+    item->favorite = record.favorite;
+    item->presenceState = record.presenceState;
+
+    // The record was prepared without reference to a person, which may label the contact
+    // differently.
+    item->nameGroup = item->person
+            ? determineNameGroup(*item, record.contact)
+            : record.nameGroup;
+
+    if (item->filterKey != record.filterKey) {
+        m_searchIndex.remove(record.iid, item->filterKey);
+        item->filterKey = record.filterKey;
+        m_stringPool.intern(&item->filterKey);
+        m_searchIndex.insert(record.iid, item->filterKey);
+    }
+
+    if (item->phoneNumbers != record.phoneNumbers) {
+        removePhoneNumbers(record.iid, item->phoneNumbers);
+        item->phoneNumbers = record.phoneNumbers;
+    }
+    foreach (const QString &phoneNumber, item->phoneNumbers)
+        m_phoneNumberIds[phoneNumber] = record.iid;
+}
+
+void SeasideCache::removePhoneNumbers(quint32 iid, const QStringList &phoneNumbers)
+{
+    // A number shared with another contact may resolve to that instead.
+    foreach (const QString &phoneNumber, phoneNumbers) {
+        QHash<QString, quint32>::iterator it = m_phoneNumberIds.find(phoneNumber);
+        if (it != m_phoneNumberIds.end() && *it == iid)
+            m_phoneNumberIds.erase(it);
+    }
+}
+
+void SeasideCache::retainCompleteContact(quint32 iid, SeasideCacheItem *item)
+{
+    // Contacts held by a person are in use, and are kept complete regardless of the budget.
+    releaseCompleteContact(item);
+    if (item->person)
+        return;
+
+    item->completeSize = estimatedSize(item->contact);
+    item->completeUsage = m_completeContacts.insert(m_completeContacts.end(), iid);
+    m_completeContactBytes += item->completeSize;
+}
+
+void SeasideCache::releaseCompleteContact(SeasideCacheItem *item)
+{
+    if (item->completeSize == 0)
+        return;
+
+    m_completeContacts.erase(item->completeUsage);
+    m_completeContactBytes -= item->completeSize;
+    item->completeSize = 0;
+}
+
+void SeasideCache::demoteCompleteContacts()
+{
+    // The summary is kept up to date with every fetch, so it can represent the contact on
+    // its own until it is next requested.
+    while (m_completeContactBytes > m_completeContactBudget) {
+        SeasideCacheItem &item = m_people[m_completeContacts.first()];
+        releaseCompleteContact(&item);
+        item.contact = QContact();
+        item.hasCompleteContact = false;
+    }
+}
+
 QList<QChar> SeasideCache::allNameGroups()
 {
     return allContactNameGroups;
@@ -381,19 +827,15 @@ SeasidePerson *SeasideCache::personById(const ContactIdType &id)
 
     quint32 iid = SeasideFilteredModel::internalId(id);
 
-    QHash<quint32, SeasideCacheItem>::iterator it = instance->m_people.find(iid);
+    CacheItemTable<SeasideCacheItem>::iterator it = instance->m_people.find(iid);
     if (it != instance->m_people.end()) {
+        ++lookupCounts.personHits;
         return person(&(*it));
     } else {
         // Insert a new item into the cache if the one doesn't exist.
+        ++lookupCounts.placeholdersCreated;
         SeasideCacheItem &cacheItem = instance->m_people[iid];
-#ifdef USING_QTPIM
-        cacheItem.contact.setId(id);
-#else
-        QContactId contactId;
-        contactId.setLocalId(id);
-        cacheItem.contact.setId(contactId);
-#endif
+        cacheItem.id = id;
         return person(&cacheItem);
     }
 }
@@ -416,24 +858,55 @@ SeasideCacheItem *SeasideCache::cacheItemById(const ContactIdType &id)
 {
     quint32 iid = SeasideFilteredModel::internalId(id);
 
-    QHash<quint32, SeasideCacheItem>::iterator it = instance->m_people.find(iid);
-    return it != instance->m_people.end()
-            ? &(*it)
-            : 0;
+    CacheItemTable<SeasideCacheItem>::iterator it = instance->m_people.find(iid);
+    if (it == instance->m_people.end()) {
+        ++lookupCounts.cacheItemMisses;
+        return 0;
+    }
+
+    ++lookupCounts.cacheItemHits;
+    return &(*it);
+}
+
+SeasideCacheItem *SeasideCache::displayedItemById(const ContactIdType &id)
+{
+    SeasideCacheItem *item = cacheItemById(id);
+
+    // The row may be displayed before its page of the list has been fetched.
+    if (!item && instance->m_populationStages[SeasideFilteredModel::FilterAll].paged)
+        instance->prioritizePage(SeasideFilteredModel::internalId(id));
+    return item;
 }
 
 QContact SeasideCache::contactById(const ContactIdType &id)
 {
     quint32 iid = SeasideFilteredModel::internalId(id);
-    return instance->m_people.value(iid, SeasideCacheItem()).contact;
+
+    CacheItemTable<SeasideCacheItem>::iterator it = instance->m_people.find(iid);
+    if (it == instance->m_people.end())
+        return QContact();
+
+    if (it->hasCompleteContact && !it->contact.isEmpty()) {
+        if (it->completeSize > 0) {
+            // Now the most recently used.
+            instance->m_completeContacts.erase(it->completeUsage);
+            it->completeUsage = instance->m_completeContacts.insert(instance->m_completeContacts.end(), iid);
+        }
+        return it->contact;
+    }
+    return summaryContact(*it);
 }
 
 SeasidePerson *SeasideCache::personByPhoneNumber(const QString &msisdn)
 {
     QString normalizedNumber = Normalization::normalizePhoneNumber(msisdn);
     QHash<QString, quint32>::const_iterator it = instance->m_phoneNumberIds.find(normalizedNumber);
-    if (it != instance->m_phoneNumberIds.end())
+    if (it != instance->m_phoneNumberIds.end()) {
+        ++lookupCounts.phoneNumbersResolved;
         return personById(*it);
+    }
+
+    ++lookupCounts.phoneNumbersUnresolved;
     return 0;
 }
 
@@ -445,15 +918,18 @@ SeasidePerson *SeasideCache::selfPerson()
 SeasidePerson *SeasideCache::person(SeasideCacheItem *cacheItem)
 {
     if (!cacheItem->person) {
+        instance->releaseCompleteContact(cacheItem);
         cacheItem->person = new SeasidePerson(instance);
-        cacheItem->person->setContact(cacheItem->contact);
-        cacheItem->filterKey.clear();
+        cacheItem->person->setContact(cacheItem->hasCompleteContact
+                ? cacheItem->contact
+                : summaryContact(*cacheItem));
 
         if (!cacheItem->hasCompleteContact) {
             // the name is a little incomplete, it's has complete or has requested complete contact.
             cacheItem->person->setComplete(false);
             cacheItem->hasCompleteContact = true;
-            instance->m_changedContacts.append(cacheItem->apiId());
+            ++lookupCounts.completeContactFetches;
+            instance->m_changedContacts.insert(cacheItem->apiId());
             instance->fetchContacts();
         }
     }
@@ -469,6 +945,12 @@ void SeasideCache::requestUpdate()
 
 bool SeasideCache::savePerson(SeasidePerson *person)
 {
+    if (!person->isComplete()) {
+        // Only the summary details are known; saving would discard the remainder.
+        qWarning() << Q_FUNC_INFO << "Cannot save an incomplete contact";
+        return false;
+    }
+
     QContact contact = person->contact();
 
     ContactIdType id = SeasideFilteredModel::apiId(contact);
@@ -516,14 +998,8 @@ void SeasideCache::removeContactData(
     if (row == -1)
         return;
 
-    QList<SeasideFilteredModel *> &models = m_models[filter];
-    for (int i = 0; i < models.count(); ++i)
-        models.at(i)->sourceAboutToRemoveItems(row, row);
-
-    m_contacts[filter].remove(row);
-
-    for (int i = 0; i < models.count(); ++i)
-        models.at(i)->sourceItemsRemoved();
+    // Also accounts for the name group and expiry of a contact removed from the all list.
+    removeRange(filter, row, 1);
 }
 
 void SeasideCache::fetchConstituents(SeasidePerson *person)
@@ -546,126 +1022,621 @@ bool SeasideCache::isPopulated(SeasideFilteredModel::FilterType filterType)
     return instance->m_populated & (1 << filterType);
 }
 
-bool SeasideCache::event(QEvent *event)
+bool SeasideCache::matchContacts(
+        SeasideFilteredModel::FilterType filterType,
+        const QStringList &prefixes,
+        QVector<ContactIdType> *contactIds)
 {
-    if (event->type() != QEvent::UpdateRequest) {
-        return QObject::event(event);
-    } else if (!m_contactsToRemove.isEmpty()) {
-        m_removeRequest.setContactIds(m_contactsToRemove);
-        m_removeRequest.start();
-
-        m_contactsToRemove.clear();
-    } else if (!m_contactsToCreate.isEmpty() || !m_contactsToSave.isEmpty()) {
-        m_contactsToCreate.reserve(m_contactsToCreate.count() + m_contactsToSave.count());
+    const QSet<quint32> iids = instance->m_searchIndex.match(prefixes);
+    const QVector<ContactIdType> &listIds = instance->m_contacts[filterType];
+    const QHash<quint32, int> &listRows = instance->contactRows(filterType);
+
+    // Only the matching contacts are ordered, by their rows in the list.
+    QVector<int> rows;
+    rows.reserve(iids.count());
+    foreach (quint32 iid, iids) {
+        QHash<quint32, int>::const_iterator it = listRows.constFind(iid);
+        if (it == listRows.constEnd())
+            continue;
 
-        typedef QHash<ContactIdType, QContact>::iterator iterator;
-        for (iterator it = m_contactsToSave.begin(); it != m_contactsToSave.end(); ++it) {
-            m_contactsToCreate.append(*it);
+        if (*it >= listIds.count() || SeasideFilteredModel::internalId(listIds.at(*it)) != iid) {
+            // The list has changed without the rows being invalidated; index them again.
+            qWarning() << "Contact rows out of date for list" << filterType;
+            instance->m_contactRows[filterType].clear();
+            return matchContacts(filterType, prefixes, contactIds);
         }
+        rows.append(*it);
+    }
+    qSort(rows);
 
-        m_saveRequest.setContacts(m_contactsToCreate);
-        m_saveRequest.start();
-
-        m_contactsToCreate.clear();
-        m_contactsToSave.clear();
-    } else if (!m_constituentIds.isEmpty()) {
-        // Fetch the constituent information (even if they're already in the
-        // cache, because we don't update non-aggregates on change notifications)
-#ifdef USING_QTPIM
-        m_fetchByIdRequest.setIds(m_constituentIds);
-#else
-        m_fetchByIdRequest.setLocalIds(m_constituentIds);
-#endif
-        m_fetchByIdRequest.start();
-    } else if (!m_contactsToFetchConstituents.isEmpty()) {
-        QContactId aggregateId = m_contactsToFetchConstituents.first();
+    contactIds->clear();
+    contactIds->reserve(rows.count());
+    for (int i = 0; i < rows.count(); ++i)
+        contactIds->append(listIds.at(rows.at(i)));
 
-        // Find the constituents of this contact
-#ifdef USING_QTPIM
-        QContact first;
-        first.setId(aggregateId);
-        m_relationshipsFetchRequest.setFirst(first);
-        m_relationshipsFetchRequest.setRelationshipType(QContactRelationship::Aggregates());
-#else
-        m_relationshipsFetchRequest.setFirst(aggregateId);
-        m_relationshipsFetchRequest.setRelationshipType(QContactRelationship::Aggregates);
-#endif
+    return true;
+}
 
-        m_relationshipsFetchRequest.start();
-    } else if (!m_changedContacts.isEmpty()) {
-        m_resultsRead = 0;
+QVariantMap SeasideCache::lookupStatistics()
+{
+    QVariantMap statistics;
+    statistics.insert(QLatin1String("cacheItemHits"), lookupCounts.cacheItemHits);
+    statistics.insert(QLatin1String("cacheItemMisses"), lookupCounts.cacheItemMisses);
+    statistics.insert(QLatin1String("personHits"), lookupCounts.personHits);
+    statistics.insert(QLatin1String("placeholdersCreated"), lookupCounts.placeholdersCreated);
+    statistics.insert(QLatin1String("completeContactFetches"), lookupCounts.completeContactFetches);
+    statistics.insert(QLatin1String("phoneNumbersResolved"), lookupCounts.phoneNumbersResolved);
+    statistics.insert(QLatin1String("phoneNumbersUnresolved"), lookupCounts.phoneNumbersUnresolved);
+    return statistics;
+}
 
-#ifdef USING_QTPIM
-        QContactIdFilter filter;
-#else
-        QContactLocalIdFilter filter;
-#endif
-        filter.setIds(m_changedContacts);
-        m_changedContacts.clear();
+void SeasideCache::resetLookupStatistics()
+{
+    const LookupStatistics zero = { 0, 0, 0, 0, 0, 0, 0 };
+    lookupCounts = zero;
+}
 
-        // A local ID filter will fetch all contacts, rather than just aggregates;
-        // we only want to retrieve aggregate contacts that have changed
-        QContactDetailFilter stFilter;
-        setDetailType<QContactSyncTarget>(stFilter, QContactSyncTarget::FieldSyncTarget);
-        stFilter.setValue("aggregate");
-
-        m_appendIndex = 0;
-        m_fetchRequest.setFilter(filter & stFilter);
-        m_fetchRequest.start();
-    } else if (m_refreshRequired) {
-        m_resultsRead = 0;
-        m_refreshRequired = false;
-        m_fetchFilter = SeasideFilteredModel::FilterFavorites;
+QVariantMap SeasideCache::coalescingStatistics()
+{
+    QVariantMap statistics;
+    statistics.insert(QLatin1String("notifications"), coalescingCounts.notifications);
+    statistics.insert(QLatin1String("contactsReported"), coalescingCounts.contactsReported);
+    statistics.insert(QLatin1String("duplicatesDropped"), coalescingCounts.duplicatesDropped);
+    statistics.insert(QLatin1String("immediateFetches"), coalescingCounts.immediateFetches);
+    statistics.insert(QLatin1String("postponedFetches"), coalescingCounts.postponedFetches);
+    statistics.insert(QLatin1String("largestFetch"), coalescingCounts.largestFetch);
+    statistics.insert(QLatin1String("postponementInterval"), instance ? instance->m_postponementInterval : 0);
+    return statistics;
+}
 
-        m_contactIdRequest.setFilter(QContactFavorite::match());
-        m_contactIdRequest.start();
-    } else {
-        m_updatesPending = false;
+void SeasideCache::resetCoalescingStatistics()
+{
+    const CoalescingStatistics zero = { 0, 0, 0, 0, 0, 0 };
+    coalescingCounts = zero;
+}
 
-        const QHash<ContactIdType,int> expiredContacts = m_expiredContacts;
-        m_expiredContacts.clear();
+static int latencyPercentile(const QVector<int> &sortedLatencies, int percentile)
+{
+    if (sortedLatencies.isEmpty())
+        return 0;
+    return sortedLatencies.at((sortedLatencies.count() - 1) * percentile / 100);
+}
 
-        typedef QHash<ContactIdType,int>::const_iterator iterator;
-        for (iterator it = expiredContacts.begin(); it != expiredContacts.end(); ++it) {
-            if (*it >= 0)
-                continue;
+QVariantMap SeasideCache::requestStatistics()
+{
+    static const char *typeNames[RequestTypesCount] = {
+        "remove", "save", "completion", "constituents", "changes", "refresh"
+    };
 
-            quint32 iid = SeasideFilteredModel::internalId(it.key());
-            QHash<quint32, SeasideCacheItem>::iterator cacheItem = m_people.find(iid);
-            if (cacheItem != m_people.end()) {
-                delete cacheItem->person;
-                m_people.erase(cacheItem);
-            }
-        }
+    QVariantMap statistics;
+    if (!instance)
+        return statistics;
+
+    for (int type = 0; type < RequestTypesCount; ++type) {
+        const RequestLane &lane = instance->m_requestLanes[type];
+
+        QVector<int> latencies = lane.latencies;
+        qSort(latencies);
+
+        // Latencies are measured in milliseconds, from the work being queued until the
+        // request doing it has finished.
+        QVariantMap laneStatistics;
+        laneStatistics.insert(QLatin1String("active"), lane.active);
+        laneStatistics.insert(QLatin1String("pending"), instance->hasRequestWork(RequestType(type)));
+        laneStatistics.insert(QLatin1String("completed"), lane.completed);
+        laneStatistics.insert(QLatin1String("latencyP50"), latencyPercentile(latencies, 50));
+        laneStatistics.insert(QLatin1String("latencyP90"), latencyPercentile(latencies, 90));
+        laneStatistics.insert(QLatin1String("latencyP99"), latencyPercentile(latencies, 99));
+        laneStatistics.insert(QLatin1String("latencyMax"), latencies.isEmpty() ? 0 : latencies.last());
+        statistics.insert(QLatin1String(typeNames[type]), laneStatistics);
     }
-    return true;
+    return statistics;
 }
 
-void SeasideCache::timerEvent(QTimerEvent *event)
+// Estimates for the heap usage of Qt containers; each hash node holds a next pointer and the
+// cached hash alongside its key and value.
+template <typename Key, typename T>
+static qint64 hashBytes(const QHash<Key, T> &hash)
 {
-    if (event->timerId() == m_fetchTimer.timerId()) {
-        fetchContacts();
-    }
+    return qint64(hash.capacity()) * sizeof(void *)
+            + qint64(hash.count()) * (sizeof(void *) + sizeof(uint) + sizeof(Key) + sizeof(T));
+}
 
-    if (event->timerId() == m_expiryTimer.timerId()) {
-        m_expiryTimer.stop();
-        instance = 0;
-        deleteLater();
-    }
+template <typename T>
+static qint64 setBytes(const QSet<T> &set)
+{
+    return qint64(set.capacity()) * sizeof(void *)
+            + qint64(set.count()) * (sizeof(void *) + sizeof(uint) + sizeof(T));
 }
 
-void SeasideCache::contactsRemoved(const QList<ContactIdType> &)
+template <typename T>
+static qint64 listBytes(const QList<T> &list)
 {
-    m_refreshRequired = true;
-    requestUpdate();
+    return qint64(list.count()) * (QTypeInfo<T>::isLarge || QTypeInfo<T>::isStatic
+            ? sizeof(void *) + sizeof(T)
+            : sizeof(void *));
 }
 
-void SeasideCache::updateContacts()
+static qint64 stringBytes(const QString &string)
 {
-    QList<ContactIdType> contactIds;
+    // QString data header followed by the null terminated characters.
+    static const int HeaderBytes = 16;
 
-    typedef QHash<quint32, SeasideCacheItem>::iterator iterator;
-    for (iterator it = m_people.begin(); it != m_people.end(); ++it) {
+    return HeaderBytes + qint64(string.size() + 1) * sizeof(QChar);
+}
+
+static QVariantMap statisticsEntry(int count, qint64 bytes)
+{
+    QVariantMap entry;
+    entry.insert(QLatin1String("count"), count);
+    entry.insert(QLatin1String("bytes"), bytes);
+    return entry;
+}
+
+QVariantMap SeasideCache::memoryStatistics()
+{
+    QVariantMap statistics;
+    if (!instance)
+        return statistics;
+
+    const SeasideCache *cache = instance;
+
+    int completeContacts = 0;
+    int persons = 0;
+    int filterTokens = 0;
+    qint64 filterKeyBytes = 0;
+    qint64 phoneNumberBytes = hashBytes(cache->m_phoneNumberIds);
+
+    typedef CacheItemTable<SeasideCacheItem>::const_iterator iterator;
+    for (iterator it = cache->m_people.begin(); it != cache->m_people.end(); ++it) {
+        if (it->hasCompleteContact)
+            ++completeContacts;
+        if (it->person)
+            ++persons;
+
+        // The token strings themselves are shared through the string pool.
+        filterTokens += it->filterKey.count();
+        filterKeyBytes += listBytes(it->filterKey);
+
+        // The number strings are shared with the keys of the numbers resolved.
+        phoneNumberBytes += listBytes(it->phoneNumbers);
+    }
+
+    typedef QHash<QString, quint32>::const_iterator phone_iterator;
+    for (phone_iterator it = cache->m_phoneNumberIds.begin(); it != cache->m_phoneNumberIds.end(); ++it)
+        phoneNumberBytes += stringBytes(it.key());
+
+    int contactListCount = 0;
+    qint64 contactListBytes = 0;
+    qint64 searchIndexBytes = cache->m_searchIndex.size();
+    for (int i = 0; i < SeasideFilteredModel::FilterTypesCount; ++i) {
+        contactListCount += cache->m_contacts[i].count();
+        contactListBytes += qint64(cache->m_contacts[i].capacity()) * sizeof(ContactIdType);
+        searchIndexBytes += hashBytes(cache->m_contactRows[i]);
+    }
+
+    int pendingCount = cache->m_contactsToSave.count()
+            + cache->m_contactsToCreate.count()
+            + cache->m_contactsToRemove.count()
+            + cache->m_changedContacts.count();
+    qint64 pendingBytes = hashBytes(cache->m_contactsToSave)
+            + listBytes(cache->m_contactsToCreate)
+            + listBytes(cache->m_contactsToRemove)
+            + setBytes(cache->m_changedContacts);
+    for (int i = 0; i < populationFilterCount; ++i) {
+        const QList<ContactRecord> &pendingRecords = cache->m_populationStages[populationFilters[i]].pendingRecords;
+        pendingCount += pendingRecords.count();
+        pendingBytes += listBytes(pendingRecords);
+    }
+
+    // The positions indexed to reconcile the lists with ids still being delivered.
+    const SynchronizeListState<ContactIdType> &queryState = cache->m_queryState;
+    const int queryIndexCount = queryState.referencePositions.count() + queryState.cachePositions.count();
+    const qint64 queryIndexBytes = hashBytes(queryState.referencePositions) + hashBytes(queryState.cachePositions);
+
+    const qint64 peopleBytes = cache->m_people.allocatedBytes();
+    const qint64 personBytes = qint64(persons) * sizeof(SeasidePerson);
+    const qint64 stringPoolBytes = cache->m_stringPool.size();
+    const qint64 nameGroupBytes = hashBytes(cache->m_contactNameGroups);
+
+    statistics.insert(QLatin1String("people"), statisticsEntry(cache->m_people.count(), peopleBytes));
+    statistics.insert(QLatin1String("persons"), statisticsEntry(persons, personBytes));
+    statistics.insert(QLatin1String("completeContacts"), completeContacts);
+    statistics.insert(QLatin1String("filterKeys"), statisticsEntry(filterTokens, filterKeyBytes));
+    statistics.insert(QLatin1String("phoneNumbers"), statisticsEntry(cache->m_phoneNumberIds.count(), phoneNumberBytes));
+    statistics.insert(QLatin1String("nameGroups"), statisticsEntry(cache->m_contactNameGroups.count(), nameGroupBytes));
+    statistics.insert(QLatin1String("lists"), statisticsEntry(contactListCount, contactListBytes));
+    statistics.insert(QLatin1String("pending"), statisticsEntry(pendingCount, pendingBytes));
+    statistics.insert(QLatin1String("queryIndex"), statisticsEntry(queryIndexCount, queryIndexBytes));
+    statistics.insert(QLatin1String("searchIndex"), statisticsEntry(cache->m_searchIndex.count(), searchIndexBytes));
+
+    QVariantMap strings = statisticsEntry(cache->m_stringPool.count(), stringPoolBytes);
+    strings.insert(QLatin1String("bytesSaved"), cache->m_stringPool.bytesSaved());
+    statistics.insert(QLatin1String("strings"), strings);
+
+    // Complete contacts and the contacts held by persons are not included; their size
+    // depends on the details the backend provides.
+    statistics.insert(QLatin1String("totalBytes"), peopleBytes + personBytes + filterKeyBytes
+            + stringPoolBytes + phoneNumberBytes + nameGroupBytes + contactListBytes + pendingBytes
+            + queryIndexBytes + searchIndexBytes);
+
+    return statistics;
+}
+
+bool SeasideCache::event(QEvent *event)
+{
+    if (event->type() != QEvent::UpdateRequest)
+        return QObject::event(event);
+
+    m_updatesPending = false;
+    markQueuedRequests();
+
+    // Start the waiting work in order of priority, as long as there is capacity for it.  Work
+    // is promoted the longer it waits, so that a stream of user changes cannot hold back a
+    // refresh indefinitely.
+    QList<QPair<qint64, int> > waiting;
+    int active = 0;
+    for (int type = 0; type < RequestTypesCount; ++type) {
+        if (m_requestLanes[type].active)
+            ++active;
+        else if (hasRequestWork(RequestType(type)))
+            waiting.append(qMakePair(requestPriority(RequestType(type)), type));
+    }
+
+    qSort(waiting);
+    for (int i = 0; i < waiting.count() && active < m_maxActiveRequests; ++i, ++active)
+        startRequest(RequestType(waiting.at(i).second));
+
+    if (active == 0)
+        updatesCompleted();
+
+    return true;
+}
+
+void SeasideCache::markQueuedRequests()
+{
+    for (int type = 0; type < RequestTypesCount; ++type) {
+        RequestLane &lane = m_requestLanes[type];
+        if (!lane.queued.isValid() && hasRequestWork(RequestType(type)))
+            lane.queued.start();
+    }
+}
+
+bool SeasideCache::hasRequestWork(RequestType type) const
+{
+    switch (type) {
+    case RemoveRequest:
+        return !m_contactsToRemove.isEmpty();
+    case SaveRequest:
+        return !m_contactsToCreate.isEmpty() || !m_contactsToSave.isEmpty();
+    case CompletionRequest:
+    case ChangeRequest:
+        if (type == ChangeRequest && m_deltaSince.isValid())
+            return true;
+        foreach (const ContactIdType &id, m_changedContacts) {
+            CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(SeasideFilteredModel::internalId(id));
+            const bool complete = it != m_people.constEnd() && it->hasCompleteContact;
+            if (complete == (type == CompletionRequest))
+                return true;
+        }
+        return false;
+    case ConstituentRequest:
+        return !m_constituentIds.isEmpty() || !m_contactsToFetchConstituents.isEmpty();
+    case RefreshRequest:
+        return m_refreshRequired;
+    default:
+        return false;
+    }
+}
+
+qint64 SeasideCache::requestPriority(RequestType type) const
+{
+    // Work the user is waiting on precedes work in the background; lower values are started
+    // first.  Work is promoted by one level for each interval it has waited.
+    static const int AgingIntervalMs = 1000;
+    static const int priorities[RequestTypesCount] = { 0, 0, 0, 1, 2, 3 };
+
+    const RequestLane &lane = m_requestLanes[type];
+    const qint64 waited = lane.queued.isValid() ? lane.queued.elapsed() : 0;
+    return qint64(priorities[type]) * AgingIntervalMs - waited;
+}
+
+void SeasideCache::startRequest(RequestType type)
+{
+    RequestLane &lane = m_requestLanes[type];
+    lane.active = true;
+    lane.resultsRead = 0;
+    lane.started = lane.queued;
+    lane.queued.invalidate();
+
+    switch (type) {
+    case RemoveRequest:
+        m_removeRequest.setContactIds(m_contactsToRemove);
+        m_removeRequest.start();
+
+        m_contactsToRemove.clear();
+        break;
+    case SaveRequest: {
+        m_contactsToCreate.reserve(m_contactsToCreate.count() + m_contactsToSave.count());
+
+        typedef QHash<ContactIdType, QContact>::iterator iterator;
+        for (iterator it = m_contactsToSave.begin(); it != m_contactsToSave.end(); ++it) {
+            m_contactsToCreate.append(*it);
+        }
+
+        m_saveRequest.setContacts(m_contactsToCreate);
+        m_saveRequest.start();
+
+        m_contactsToCreate.clear();
+        m_contactsToSave.clear();
+        break;
+    }
+    case ConstituentRequest:
+        if (!m_constituentIds.isEmpty()) {
+            // Fetch the constituent information (even if they're already in the
+            // cache, because we don't update non-aggregates on change notifications)
+#ifdef USING_QTPIM
+            m_fetchByIdRequest.setIds(m_constituentIds);
+#else
+            m_fetchByIdRequest.setLocalIds(m_constituentIds);
+#endif
+            m_fetchByIdRequest.start();
+        } else {
+            QContactId aggregateId = m_contactsToFetchConstituents.first();
+
+            // Find the constituents of this contact
+#ifdef USING_QTPIM
+            QContact first;
+            first.setId(aggregateId);
+            m_relationshipsFetchRequest.setFirst(first);
+            m_relationshipsFetchRequest.setRelationshipType(QContactRelationship::Aggregates());
+#else
+            m_relationshipsFetchRequest.setFirst(aggregateId);
+            m_relationshipsFetchRequest.setRelationshipType(QContactRelationship::Aggregates);
+#endif
+
+            m_relationshipsFetchRequest.start();
+        }
+        break;
+    case ChangeRequest:
+        if (m_deltaSince.isValid()) {
+            // Find the contacts removed since the cache was last in sync with the backend; those
+            // added or modified are fetched once they have been removed from the lists.
+            QContactChangeLogFilter removedFilter;
+            removedFilter.setEventType(QContactChangeLogFilter::EventRemoved);
+            removedFilter.setSince(m_deltaSince);
+
+            m_deltaSince = QDateTime();
+
+            m_fetchingDelta = true;
+            m_removedIdRequest.setFilter(removedFilter);
+            m_removedIdRequest.start();
+            break;
+        }
+        // Fall through.
+    case CompletionRequest: {
+        // Contacts held in full must be fetched in full; for the others, only the details
+        // of the summary are needed.
+        QList<ContactIdType> fetchIds;
+        for (QSet<ContactIdType>::iterator changed = m_changedContacts.begin(); changed != m_changedContacts.end();) {
+            CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(SeasideFilteredModel::internalId(*changed));
+            const bool complete = it != m_people.constEnd() && it->hasCompleteContact;
+            if (complete == (type == CompletionRequest)) {
+                fetchIds.append(*changed);
+                changed = m_changedContacts.erase(changed);
+            } else {
+                ++changed;
+            }
+        }
+
+#ifdef USING_QTPIM
+        QContactIdFilter filter;
+#else
+        QContactLocalIdFilter filter;
+#endif
+        filter.setIds(fetchIds);
+
+        // A local ID filter will fetch all contacts, rather than just aggregates;
+        // we only want to retrieve aggregate contacts that have changed
+        if (type == CompletionRequest) {
+            m_completionRequest.setFilter(filter & aggregateFilter());
+            m_completionRequest.start();
+        } else {
+            startFetch(filter & aggregateFilter(), ListProfile);
+        }
+        break;
+    }
+    case RefreshRequest:
+        m_refreshRequired = false;
+        m_fetchFilter = SeasideFilteredModel::FilterAll;
+
+        m_contactIdRequest.setFilter(populationFilter(SeasideFilteredModel::FilterAll));
+        m_contactIdRequest.start();
+        break;
+    default:
+        break;
+    }
+}
+
+void SeasideCache::finishRequest(RequestType type)
+{
+    // Latencies are kept for the most recent requests of each type.
+    static const int LatencySampleCount = 100;
+
+    RequestLane &lane = m_requestLanes[type];
+    lane.active = false;
+    ++lane.completed;
+
+    if (type == RefreshRequest)
+        fetchStageFinished();
+
+    if (lane.started.isValid()) {
+        const int latency = int(lane.started.elapsed());
+        if (lane.latencies.count() < LatencySampleCount)
+            lane.latencies.append(latency);
+        else
+            lane.latencies[lane.completed % LatencySampleCount] = latency;
+        lane.started.invalidate();
+    }
+
+    // Start any further work, or complete the update.
+    requestUpdate();
+}
+
+void SeasideCache::updatesCompleted()
+{
+    const QHash<ContactIdType,int> expiredContacts = m_expiredContacts;
+    m_expiredContacts.clear();
+
+    typedef QHash<ContactIdType,int>::const_iterator iterator;
+    for (iterator it = expiredContacts.begin(); it != expiredContacts.end(); ++it) {
+        if (*it >= 0)
+            continue;
+
+        quint32 iid = SeasideFilteredModel::internalId(it.key());
+        CacheItemTable<SeasideCacheItem>::iterator cacheItem = m_people.find(iid);
+        if (cacheItem != m_people.end()) {
+            delete cacheItem->person;
+            releaseCompleteContact(&(*cacheItem));
+            m_searchIndex.remove(iid, cacheItem->filterKey);
+            m_people.erase(cacheItem);
+        }
+    }
+
+    demoteCompleteContacts();
+
+    // Drop any names and search tokens which belonged only to contacts since removed or changed.
+    m_stringPool.purge();
+
+    if (!m_contactsUpdated) {
+        // All reported changes have been applied; allow a margin for changes whose
+        // notifications have not yet been delivered.
+        static const int WatermarkMarginSecs = 60;
+
+        m_syncWatermark = QDateTime::currentDateTimeUtc().addSecs(-WatermarkMarginSecs);
+        scheduleSnapshot();
+    }
+}
+
+void SeasideCache::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_fetchTimer.timerId()) {
+        fetchContacts();
+    }
+
+    if (event->timerId() == m_populationTimer.timerId()) {
+        appendPendingContacts();
+    }
+
+    if (event->timerId() == m_snapshotTimer.timerId()) {
+        m_snapshotTimer.stop();
+        writeSnapshot();
+    }
+
+    if (event->timerId() == m_expiryTimer.timerId()) {
+        m_expiryTimer.stop();
+        instance = 0;
+        deleteLater();
+    }
+}
+
+void SeasideCache::contactsRemoved(const QList<ContactIdType> &contactIds)
+{
+    if (m_fetchFilter != SeasideFilteredModel::FilterNone
+            || !isPopulated(SeasideFilteredModel::FilterAll)) {
+        // The lists are being read from the backend, and may or may not include the removed
+        // contacts; read them again once that is complete.
+        m_refreshRequired = true;
+        requestUpdate();
+        return;
+    }
+
+    QSet<ContactIdType> removedIds;
+    QSet<quint32> removedIids;
+    foreach (const ContactIdType &id, contactIds) {
+        removedIds.insert(id);
+        removedIids.insert(SeasideFilteredModel::internalId(id));
+        m_changedContacts.remove(id);
+    }
+
+    const int allCount = m_contacts[SeasideFilteredModel::FilterAll].count();
+    removeContacts(SeasideFilteredModel::FilterAll, removedIds);
+    const int removedCount = allCount - m_contacts[SeasideFilteredModel::FilterAll].count();
+
+    for (int i = 0; i < derivedFilterCount; ++i) {
+        // Every member of a derived list is also listed in the all list, and was removed
+        // from that too; otherwise the lists are inconsistent and are read again.
+        const QVector<ContactIdType> &derivedIds = m_contacts[derivedFilters[i]];
+        const int derivedCount = derivedIds.count();
+        removeContacts(derivedFilters[i], removedIds);
+        if (derivedCount - derivedIds.count() > removedCount)
+            m_refreshRequired = true;
+    }
+
+    // The numbers of removed contacts no longer resolve to them.
+    foreach (quint32 iid, removedIids) {
+        CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(iid);
+        if (it != m_people.constEnd())
+            removePhoneNumbers(iid, it->phoneNumbers);
+    }
+
+    // Release the removed contacts once no longer listed.
+    requestUpdate();
+}
+
+const QHash<quint32, int> &SeasideCache::contactRows(SeasideFilteredModel::FilterType filter)
+{
+    // The rows are discarded whenever contacts are inserted into, removed from or moved within
+    // the list, but contacts appended to it are only added.
+    QHash<quint32, int> &rows = m_contactRows[filter];
+    const QVector<ContactIdType> &contactIds = m_contacts[filter];
+
+    if (rows.count() > contactIds.count())
+        rows.clear();
+    for (int i = rows.count(); i < contactIds.count(); ++i)
+        rows.insert(SeasideFilteredModel::internalId(contactIds.at(i)), i);
+
+    return rows;
+}
+
+void SeasideCache::removeContacts(
+        SeasideFilteredModel::FilterType filter, const QSet<ContactIdType> &contactIds)
+{
+    const QVector<ContactIdType> &cacheIds = m_contacts[filter];
+
+    // Remove each run of consecutive rows together, from the end of the list so that the
+    // rows preceding are unaffected.
+    for (int end = cacheIds.count(); end > 0;) {
+        if (!contactIds.contains(cacheIds.at(end - 1))) {
+            --end;
+            continue;
+        }
+
+        int begin = end - 1;
+        while (begin > 0 && contactIds.contains(cacheIds.at(begin - 1)))
+            --begin;
+
+        removeRange(filter, begin, end - begin);
+        end = begin;
+    }
+}
+
+void SeasideCache::updateContacts()
+{
+    if (m_syncWatermark.isValid()) {
+        // The changes are not identified, but the backend can report those made since the
+        // cache was last in sync with it; fetch only those, and read the lists again only if
+        // contacts were added or their names changed.
+        if (!m_deltaSince.isValid() || m_syncWatermark < m_deltaSince)
+            m_deltaSince = m_syncWatermark;
+        requestUpdate();
+        return;
+    }
+
+    QList<ContactIdType> contactIds;
+
+    typedef CacheItemTable<SeasideCacheItem>::iterator iterator;
+    for (iterator it = m_people.begin(); it != m_people.end(); ++it) {
         if (it->hasCompleteContact)
             contactIds.append(it->apiId());
     }
@@ -673,6 +1644,209 @@ void SeasideCache::updateContacts()
     updateContacts(contactIds);
 }
 
+QContactFetchHint SeasideCache::fetchHint(FetchProfile profile)
+{
+    return profile == ListProfile ? listFetchHint() : QContactFetchHint();
+}
+
+void SeasideCache::startPopulation()
+{
+    const FetchProfile profile = fetchProfilesEnabled() ? ListProfile : CompleteProfile;
+
+    // Each list is queried independently, so that none waits for the results of another.
+    m_updatesPending = true;
+    for (int i = 0; i < populationFilterCount; ++i) {
+        const SeasideFilteredModel::FilterType filter = populationFilters[i];
+        PopulationStage &stage = m_populationStages[filter];
+
+        stage.appendIndex = 0;
+        stage.profile = profile;
+        stage.fetching = true;
+
+        if (filter == SeasideFilteredModel::FilterAll && m_pageSize > 0) {
+            // Only the first rows of a long list are visible initially; fetch its order
+            // before any content, so those rows can be fetched first.
+            stage.paged = true;
+            stage.fetchingIds = true;
+            m_contactIdRequest.setFilter(populationFilter(filter));
+            m_contactIdRequest.start();
+            continue;
+        }
+
+        stage.request.setFetchHint(fetchHint(profile));
+        stage.request.setFilter(populationFilter(filter));
+        stage.request.start();
+    }
+}
+
+void SeasideCache::pagedIdsAvailable()
+{
+    PopulationStage &stage = m_populationStages[SeasideFilteredModel::FilterAll];
+    stage.fetchingIds = false;
+
+    if (m_contactIdRequest.error() != QContactManager::NoError)
+        qWarning() << "Unable to fetch contact ids:" << m_contactIdRequest.error();
+
+    stage.pagedIds = m_contactIdRequest.ids();
+    stage.pagedRows.reserve(stage.pagedIds.count());
+    for (int i = 0; i < stage.pagedIds.count(); ++i)
+        stage.pagedRows.insert(SeasideFilteredModel::internalId(stage.pagedIds.at(i)), i);
+
+    stage.requestedPages.resize((stage.pagedIds.count() + m_pageSize - 1) / m_pageSize);
+    stage.nextPage = 0;
+    stage.pageRun = 1;
+
+    // Every row is inserted immediately, rows without content are filled in as their
+    // pages are fetched.
+    QVector<ContactIdType> &cacheIds = m_contacts[SeasideFilteredModel::FilterAll];
+    QList<SeasideFilteredModel *> &models = m_models[SeasideFilteredModel::FilterAll];
+    if (!stage.pagedIds.isEmpty()) {
+        const int begin = cacheIds.count();
+        const int end = begin + stage.pagedIds.count() - 1;
+
+        for (int i = 0; i < models.count(); ++i)
+            models.at(i)->sourceAboutToInsertItems(begin, end);
+
+        cacheIds.reserve(cacheIds.count() + stage.pagedIds.count());
+        for (int i = 0; i < stage.pagedIds.count(); ++i)
+            cacheIds.append(stage.pagedIds.at(i));
+
+        for (int i = 0; i < models.count(); ++i)
+            models.at(i)->sourceItemsInserted(begin, end);
+    }
+
+    fetchNextPage();
+}
+
+void SeasideCache::prioritizePage(quint32 iid)
+{
+    // Only the most recently displayed pages are fetched out of order.
+    static const int MaximumPriorityPages = 8;
+
+    PopulationStage &stage = m_populationStages[SeasideFilteredModel::FilterAll];
+
+    QHash<quint32, int>::const_iterator it = stage.pagedRows.constFind(iid);
+    if (it == stage.pagedRows.constEnd())
+        return;
+
+    const int page = *it / m_pageSize;
+    if (stage.requestedPages.testBit(page))
+        return;
+
+    stage.priorityPages.removeAll(page);
+    stage.priorityPages.append(page);
+    if (stage.priorityPages.count() > MaximumPriorityPages)
+        stage.priorityPages.removeFirst();
+}
+
+void SeasideCache::fetchNextPage()
+{
+    // Pages of displayed rows are fetched one at a time; the rest of the list is fetched in
+    // runs of pages, doubling in length up to this many, so a long list takes few queries.
+    static const int MaximumPageRun = 16;
+
+    PopulationStage &stage = m_populationStages[SeasideFilteredModel::FilterAll];
+
+    int first = -1;
+    while (first < 0 && !stage.priorityPages.isEmpty()) {
+        const int page = stage.priorityPages.takeLast();
+        if (!stage.requestedPages.testBit(page))
+            first = page;
+    }
+
+    int last = first;
+    while (first < 0 && stage.nextPage < stage.requestedPages.size()) {
+        const int page = stage.nextPage++;
+        if (!stage.requestedPages.testBit(page)) {
+            first = page;
+            last = page;
+            while (last + 1 < stage.requestedPages.size() && last + 1 - first < stage.pageRun
+                    && !stage.requestedPages.testBit(last + 1)) {
+                ++last;
+            }
+            stage.nextPage = last + 1;
+            stage.pageRun = qMin(stage.pageRun * 2, MaximumPageRun);
+        }
+    }
+
+    if (first < 0) {
+        // Every page has been fetched.
+        stage.fetching = false;
+        populationStageFinished();
+        return;
+    }
+
+    for (int page = first; page <= last; ++page)
+        stage.requestedPages.setBit(page);
+
+    const QList<ContactIdType> pageIds = stage.pagedIds.mid(first * m_pageSize, (last - first + 1) * m_pageSize);
+
+#ifdef USING_QTPIM
+    QContactIdFilter filter;
+#else
+    QContactLocalIdFilter filter;
+#endif
+    filter.setIds(pageIds);
+
+    stage.appendIndex = 0;
+    stage.request.setFetchHint(fetchHint(stage.profile));
+    stage.request.setFilter(filter);
+    stage.request.start();
+}
+
+void SeasideCache::appendPage(const QList<ContactRecord> &records)
+{
+    PopulationStage &stage = m_populationStages[SeasideFilteredModel::FilterAll];
+    const QVector<ContactIdType> &cacheIds = m_contacts[SeasideFilteredModel::FilterAll];
+    QList<SeasideFilteredModel *> &models = m_models[SeasideFilteredModel::FilterAll];
+    QList<QChar> modifiedGroups;
+
+    int begin = -1;
+    int end = -1;
+    foreach (const ContactRecord &record, records) {
+        const ContactIdType apiId = record.id;
+        const quint32 iid = record.iid;
+
+        SeasideCacheItem &cacheItem = m_people[iid];
+        updateSummary(&cacheItem, record);
+
+        if (cacheItem.hasCompleteContact && stage.profile == CompleteProfile) {
+            cacheItem.contact = record.contact;
+            retainCompleteContact(iid, &cacheItem);
+        }
+
+        // The rows of the page were counted in no name group when they were inserted.
+        const int row = stage.pagedRows.value(iid, -1);
+        if (row >= 0 && row < cacheIds.count() && cacheIds.at(row) == apiId) {
+            addToContactNameGroup(nameGroupForCacheItem(&cacheItem), &modifiedGroups);
+            begin = begin < 0 ? row : qMin(begin, row);
+            end = qMax(end, row);
+        } else if (cacheIds.contains(apiId)) {
+            // The list has changed since the ids were fetched.
+            addToContactNameGroup(nameGroupForCacheItem(&cacheItem), &modifiedGroups);
+            updateContactData(apiId, SeasideFilteredModel::FilterAll);
+        }
+    }
+
+    if (begin >= 0) {
+        for (int i = 0; i < models.count(); ++i)
+            models.at(i)->sourceDataChanged(begin, end);
+    }
+
+    notifyNameGroupsChanged(modifiedGroups);
+}
+
+void SeasideCache::startFetch(const QContactFilter &filter, FetchProfile profile)
+{
+    if (!fetchProfilesEnabled())
+        profile = CompleteProfile;
+
+    m_fetchProfile = profile;
+    m_fetchRequest.setFetchHint(fetchHint(profile));
+    m_fetchRequest.setFilter(filter);
+    m_fetchRequest.start();
+}
+
 void SeasideCache::fetchContacts()
 {
     static const int WaitIntervalMs = 250;
@@ -684,6 +1858,8 @@ void SeasideCache::fetchContacts()
         m_fetchTimer.stop();
         m_fetchPostponed.invalidate();
 
+        coalescingCounts.largestFetch = qMax<quint64>(coalescingCounts.largestFetch, m_changedContacts.count());
+
         // Fetch any changed contacts immediately
         if (m_contactsUpdated) {
             m_contactsUpdated = false;
@@ -693,111 +1869,278 @@ void SeasideCache::fetchContacts()
     }
 }
 
-void SeasideCache::updateContacts(const QList<ContactIdType> &contactIds)
+void SeasideCache::updateContacts(const QList<ContactIdType> &contactIds)
+{
+    // Changes reported within this interval of the previous ones are part of a burst, whose
+    // changes are accumulated before being fetched; others are fetched immediately.
+    static const int BurstIntervalMs = 1000;
+
+    // Wait for new changes to be reported, for longer as the burst continues
+    static const int MinPostponementIntervalMs = 50;
+    static const int MaxPostponementIntervalMs = 1000;
+
+    // Maximum wait until we fetch all changes previously reported
+    static const int MaxPostponementMs = 5000;
+
+    ++coalescingCounts.notifications;
+    coalescingCounts.contactsReported += contactIds.count();
+
+    const int changedCount = m_changedContacts.count();
+    foreach (const ContactIdType &id, contactIds)
+        m_changedContacts.insert(id);
+    coalescingCounts.duplicatesDropped += contactIds.count() - (m_changedContacts.count() - changedCount);
+
+    m_contactsUpdated = true;
+
+    const bool burst = m_changeReported.isValid() && m_changeReported.elapsed() < BurstIntervalMs;
+    m_changeReported.restart();
+
+    if (!burst) {
+        // An isolated change; fetch it as soon as control returns to the event loop, along
+        // with any changes reported at the same time.
+        m_postponementInterval = 0;
+        ++coalescingCounts.immediateFetches;
+        m_fetchTimer.start(0, this);
+        return;
+    }
+
+    m_postponementInterval = m_postponementInterval > 0
+            ? std::min(m_postponementInterval * 2, MaxPostponementIntervalMs)
+            : MinPostponementIntervalMs;
+
+    if (m_fetchPostponed.isValid()) {
+        // We are waiting to accumulate further changes
+        int remainder = MaxPostponementMs - m_fetchPostponed.elapsed();
+        if (remainder > 0) {
+            // We can postpone further
+            m_fetchTimer.start(std::min(remainder, m_postponementInterval), this);
+        }
+    } else {
+        // Wait for further changes before we query for the ones we have now
+        ++coalescingCounts.postponedFetches;
+        m_fetchPostponed.restart();
+        m_fetchTimer.start(m_postponementInterval, this);
+    }
+}
+
+void SeasideCache::contactsAvailable()
+{
+    QContactAbstractRequest *request = static_cast<QContactAbstractRequest *>(sender());
+
+    for (int i = 0; i < populationFilterCount; ++i) {
+        const SeasideFilteredModel::FilterType filter = populationFilters[i];
+        PopulationStage &stage = m_populationStages[filter];
+        if (request == &stage.request) {
+            // Part of an initial query.
+            const QList<QContact> contacts = stage.request.contacts();
+            processContacts(filter, contacts.mid(stage.appendIndex), stage.profile);
+            stage.appendIndex = contacts.count();
+            return;
+        }
+    }
+
+    // An update.
+    if (request == &m_fetchByIdRequest) {
+        RequestLane &lane = m_requestLanes[ConstituentRequest];
+        const QList<QContact> contacts = m_fetchByIdRequest.contacts();
+        processContacts(SeasideFilteredModel::FilterNone, contacts.mid(lane.resultsRead), CompleteProfile);
+        lane.resultsRead = contacts.count();
+    } else if (request == &m_completionRequest) {
+        RequestLane &lane = m_requestLanes[CompletionRequest];
+        const QList<QContact> contacts = m_completionRequest.contacts();
+        processContacts(SeasideFilteredModel::FilterNone, contacts.mid(lane.resultsRead), CompleteProfile);
+        lane.resultsRead = contacts.count();
+    } else {
+        RequestLane &lane = m_requestLanes[ChangeRequest];
+        const QList<QContact> contacts = m_fetchRequest.contacts();
+        processContacts(SeasideFilteredModel::FilterNone, contacts.mid(lane.resultsRead), m_fetchProfile);
+        lane.resultsRead = contacts.count();
+    }
+}
+
+void SeasideCache::processContacts(
+        SeasideFilteredModel::FilterType filter,
+        const QList<QContact> &contacts,
+        FetchProfile profile)
+{
+    if (contacts.isEmpty())
+        return;
+
+    if (!m_processInBackground) {
+        applyRecords(filter, ContactRecords::prepare(contacts, m_displayLabelOrder), profile);
+        return;
+    }
+
+    // Batches may be prepared concurrently, but are applied in the order they were fetched.
+    ProcessingBatch batch;
+    batch.watcher = new QFutureWatcher<QList<ContactRecord> >(this);
+    batch.filter = filter;
+    batch.profile = profile;
+    m_processingBatches.append(batch);
+
+    connect(batch.watcher, SIGNAL(finished()), this, SLOT(recordsProcessed()));
+
+    QList<ContactRecord> (*prepare)(const QList<QContact> &, SeasideFilteredModel::DisplayLabelOrder)
+            = &ContactRecords::prepare;
+    batch.watcher->setFuture(QtConcurrent::run(prepare, contacts, m_displayLabelOrder));
+}
+
+bool SeasideCache::isProcessing(SeasideFilteredModel::FilterType filter) const
 {
-    // Wait for new changes to be reported
-    static const int PostponementIntervalMs = 500;
-
-    // Maximum wait until we fetch all changes previously reported
-    static const int MaxPostponementMs = 5000;
+    for (int i = 0; i < m_processingBatches.count(); ++i) {
+        if (m_processingBatches.at(i).filter == filter)
+            return true;
+    }
+    return false;
+}
 
-    m_contactsUpdated = true;
-    m_changedContacts.append(contactIds);
+void SeasideCache::recordsProcessed()
+{
+    while (!m_processingBatches.isEmpty() && m_processingBatches.first().watcher->isFinished()) {
+        const ProcessingBatch batch = m_processingBatches.takeFirst();
+        const QList<ContactRecord> records = batch.watcher->result();
+        batch.watcher->deleteLater();
 
-    if (m_fetchPostponed.isValid()) {
-        // We are waiting to accumulate further changes
-        int remainder = MaxPostponementMs - m_fetchPostponed.elapsed();
-        if (remainder > 0) {
-            // We can postpone further
-            m_fetchTimer.start(std::min(remainder, PostponementIntervalMs), this);
-        }
-    } else {
-        // Wait for further changes before we query for the ones we have now
-        m_fetchPostponed.restart();
-        m_fetchTimer.start(PostponementIntervalMs, this);
+        applyRecords(batch.filter, records, batch.profile);
     }
 }
 
-void SeasideCache::contactsAvailable()
+void SeasideCache::applyRecords(
+        SeasideFilteredModel::FilterType filter,
+        const QList<ContactRecord> &records,
+        FetchProfile profile)
 {
-    QContactAbstractRequest *request = static_cast<QContactAbstractRequest *>(sender());
+    if (filter == SeasideFilteredModel::FilterNone) {
+        applyUpdates(records, profile);
+
+        if (!isProcessing(SeasideFilteredModel::FilterNone)) {
+            // Complete the requests which were waiting for their results to be applied.
+            for (int type = 0; type < RequestTypesCount; ++type) {
+                if (m_requestLanes[type].awaitingRecords) {
+                    m_requestLanes[type].awaitingRecords = false;
+                    finishRequest(RequestType(type));
+                }
+            }
+        }
+        return;
+    }
 
-    QList<QContact> contacts;
-    if (request == &m_fetchByIdRequest) {
-        contacts = m_fetchByIdRequest.contacts();
-    } else {
-        contacts = m_fetchRequest.contacts();
+    PopulationStage &stage = m_populationStages[filter];
+    if (stage.paged) {
+        appendPage(records);
+        populationStageFinished();
+        return;
     }
 
-    if (m_fetchFilter == SeasideFilteredModel::FilterFavorites
-            || m_fetchFilter == SeasideFilteredModel::FilterOnline
-            || m_fetchFilter == SeasideFilteredModel::FilterAll) {
-        // Part of an initial query.
-        appendContacts(contacts);
-    } else {
-        // An update.
-        QList<QChar> modifiedGroups;
+    // Queue the new results; they are inserted in time-sliced batches so that a large result
+    // set doesn't stall the event loop.
+    stage.pendingRecords += records;
+
+    if (!m_populationTimer.isActive())
+        appendPendingContacts();
+}
 
-        for (int i = m_resultsRead; i < contacts.count(); ++i) {
-            QContact contact = contacts.at(i);
-            ContactIdType apiId = SeasideFilteredModel::apiId(contact);
-            quint32 iid = SeasideFilteredModel::internalId(contact);
+void SeasideCache::applyUpdates(const QList<ContactRecord> &records, FetchProfile profile)
+{
+    QList<QChar> modifiedGroups;
+    QSet<ContactIdType> derivedChanges[derivedFilterCount];
 
-            SeasideCacheItem &item = m_people[iid];
-            QContactName oldName = item.contact.detail<QContactName>();
-            QContactName newName = contact.detail<QContactName>();
-            QChar oldNameGroup;
+    // The lists are not changed until all the records have been applied.
+    const QHash<quint32, int> &allRows = contactRows(SeasideFilteredModel::FilterAll);
 
-            if (m_fetchFilter == SeasideFilteredModel::FilterAll)
-                oldNameGroup = nameGroupForCacheItem(&item);
+    foreach (ContactRecord record, records) {
+        const ContactIdType apiId = record.id;
+        const quint32 iid = record.iid;
 
+        SeasideCacheItem &item = m_people[iid];
+        QChar oldNameGroup;
+
+        // The name groups count the contacts of the all list; those being inserted into it
+        // are counted then.
+        const bool listed = allRows.contains(iid);
+        if (listed)
+            oldNameGroup = nameGroupForCacheItem(&item);
+
+        if (record.displayLabel.isEmpty()) {
+            // Retain the label generated for the contact.
+            QContactName newName = record.contact.detail<QContactName>();
 #ifdef USING_QTPIM
-            if (newName.value<QString>(QContactName__FieldCustomLabel).isEmpty()) {
-#else
-            if (newName.customLabel().isEmpty()) {
-#endif
-#ifdef USING_QTPIM
-                newName.setValue(QContactName__FieldCustomLabel, oldName.value(QContactName__FieldCustomLabel));
+            newName.setValue(QContactName__FieldCustomLabel, item.displayLabel);
 #else
-                newName.setCustomLabel(oldName.customLabel());
+            newName.setCustomLabel(item.displayLabel);
 #endif
-                contact.saveDetail(&newName);
-            }
+            record.contact.saveDetail(&newName);
+            record.displayLabel = item.displayLabel;
 
-            const bool roleDataChanged = newName != oldName
-                    || contact.detail<QContactAvatar>().imageUrl() != item.contact.detail<QContactAvatar>().imageUrl();
+            // Without a name, the group is determined by the label.
+            if (record.firstName.isEmpty() && record.lastName.isEmpty())
+                record.nameGroup = determineNameGroup(record.contact, m_displayLabelOrder);
+        }
+
+        const QString oldFirstName = item.firstName;
+        const QString oldLastName = item.lastName;
+        const QString oldDisplayLabel = item.displayLabel;
+        const QUrl oldAvatarUrl = item.avatarUrl;
+        const QStringList oldFilterKey = item.filterKey;
 
-            item.contact = contact;
+        if (profile == CompleteProfile) {
+            item.contact = record.contact;
             item.hasCompleteContact = true;
+            retainCompleteContact(iid, &item);
             if (item.person) {
-                item.person->setContact(contact);
+                item.person->setContact(record.contact);
                 item.person->setComplete(true);
-                item.filterKey.clear();
             }
+        } else if (item.hasCompleteContact) {
+            // Only the summary details were fetched; fetch the rest again.
+            m_changedContacts.insert(apiId);
+        }
+        updateSummary(&item, record);
+
+        const bool roleDataChanged = item.firstName != oldFirstName
+                || item.lastName != oldLastName
+                || item.displayLabel != oldDisplayLabel
+                || item.avatarUrl != oldAvatarUrl
+                || item.filterKey != oldFilterKey;
+
+        // A renamed contact may be ordered differently; read the lists again to place it.
+        if (listed && (item.firstName != oldFirstName
+                || item.lastName != oldLastName
+                || item.displayLabel != oldDisplayLabel)) {
+            m_refreshRequired = true;
+        }
 
-             QList<QContactPhoneNumber> phoneNumbers = contact.details<QContactPhoneNumber>();
-             for (int j = 0; j < phoneNumbers.count(); ++j) {
-                 m_phoneNumberIds[phoneNumbers.at(j).number()] = iid;
-             }
-
-             if (m_fetchFilter == SeasideFilteredModel::FilterAll) {
-                 // do this even if !roleDataChanged as name groups are affected by other display label changes
-                 QChar newNameGroup = nameGroupForCacheItem(&item);
-                 if (newNameGroup != oldNameGroup) {
-                     addToContactNameGroup(newNameGroup, &modifiedGroups);
-                     removeFromContactNameGroup(oldNameGroup, &modifiedGroups);
-                 }
-             }
-
-             if (roleDataChanged) {
-                instance->updateContactData(apiId, SeasideFilteredModel::FilterFavorites);
-                instance->updateContactData(apiId, SeasideFilteredModel::FilterOnline);
-                instance->updateContactData(apiId, SeasideFilteredModel::FilterAll);
-             }
+        if (listed) {
+            // do this even if !roleDataChanged as name groups are affected by other display label changes
+            QChar newNameGroup = nameGroupForCacheItem(&item);
+            if (newNameGroup != oldNameGroup) {
+                addToContactNameGroup(newNameGroup, &modifiedGroups);
+                removeFromContactNameGroup(oldNameGroup, &modifiedGroups);
+            }
+        }
+
+        if (roleDataChanged) {
+            updateContactData(apiId, SeasideFilteredModel::FilterFavorites);
+            updateContactData(apiId, SeasideFilteredModel::FilterOnline);
+            updateContactData(apiId, SeasideFilteredModel::FilterAll);
+        }
+
+        // A change of favorite status or presence moves the contact in or out of the favorites
+        // or online list, without a query.
+        for (int i = 0; i < derivedFilterCount; ++i) {
+            const SeasideFilteredModel::FilterType filter = derivedFilters[i];
+            if (isPopulated(SeasideFilteredModel::FilterAll) && isPopulated(filter)
+                    && contactRows(filter).contains(iid) != isDerivedMember(filter, item)) {
+                derivedChanges[i].insert(apiId);
+            }
         }
-        m_resultsRead = contacts.count();
-        notifyNameGroupsChanged(modifiedGroups);
     }
+
+    for (int i = 0; i < derivedFilterCount; ++i) {
+        if (!derivedChanges[i].isEmpty())
+            updateDerivedList(derivedFilters[i], derivedChanges[i]);
+    }
+    notifyNameGroupsChanged(modifiedGroups);
 }
 
 void SeasideCache::addToContactNameGroup(const QChar &group, QList<QChar> *modifiedGroups)
@@ -833,12 +2176,19 @@ void SeasideCache::notifyNameGroupsChanged(const QList<QChar> &groups)
 
 void SeasideCache::contactIdsAvailable()
 {
+    // The ids of a paged list are only read once all of them are available.
+    if (m_populationStages[SeasideFilteredModel::FilterAll].fetchingIds)
+        return;
+
+    // The ids delivered so far are shared with the request rather than copied, and the state
+    // retained from earlier results means only those delivered since are indexed.
     synchronizeList(
             this,
             m_contacts[m_fetchFilter],
             m_cacheIndex,
             m_contactIdRequest.ids(),
-            m_queryIndex);
+            m_queryIndex,
+            m_queryState);
 }
 
 void SeasideCache::relationshipsAvailable()
@@ -862,7 +2212,12 @@ void SeasideCache::relationshipsAvailable()
 
 void SeasideCache::finalizeUpdate(SeasideFilteredModel::FilterType filter)
 {
-    const QList<ContactIdType> queryIds = m_contactIdRequest.ids();
+    finalizeUpdate(filter, m_contactIdRequest.ids());
+}
+
+void SeasideCache::finalizeUpdate(
+        SeasideFilteredModel::FilterType filter, const QList<ContactIdType> &queryIds)
+{
     QVector<ContactIdType> &cacheIds = m_contacts[filter];
 
     if (m_cacheIndex < cacheIds.count())
@@ -876,6 +2231,7 @@ void SeasideCache::finalizeUpdate(SeasideFilteredModel::FilterType filter)
 
     m_cacheIndex = 0;
     m_queryIndex = 0;
+    m_queryState.clear();
 }
 
 void SeasideCache::removeRange(
@@ -885,19 +2241,22 @@ void SeasideCache::removeRange(
     QList<SeasideFilteredModel *> &models = m_models[filter];
     QList<QChar> modifiedNameGroups;
 
+    m_contactRows[filter].clear();
+
     for (int i = 0; i < models.count(); ++i)
         models[i]->sourceAboutToRemoveItems(index, index + count - 1);
 
-    for (int i = 0; i < count; ++i) {
-        if (filter == SeasideFilteredModel::FilterAll) {
-            m_expiredContacts[cacheIds.at(index)] -= 1;
+    if (filter == SeasideFilteredModel::FilterAll) {
+        for (int i = index; i < index + count; ++i) {
+            m_expiredContacts[cacheIds.at(i)] -= 1;
 
-            removeFromContactNameGroup(nameGroupForCacheItem(cacheItemById(cacheIds.at(index))), &modifiedNameGroups);
+            removeFromContactNameGroup(nameGroupForCacheItem(cacheItemById(cacheIds.at(i))), &modifiedNameGroups);
         }
-
-        cacheIds.remove(index);
     }
 
+    // Remove the whole range at once, so the tail of the list is moved only once.
+    cacheIds.remove(index, count);
+
     for (int i = 0; i < models.count(); ++i)
         models[i]->sourceItemsRemoved();
 
@@ -917,72 +2276,266 @@ int SeasideCache::insertRange(
 
     const ContactIdType selfId = m_manager.selfContactId();
 
-    int end = index + count - 1;
+    // The self contact is never listed, so the rows reported are those actually inserted.
+    QVector<ContactIdType> insertIds;
+    insertIds.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (queryIds.at(queryIndex + i) != selfId)
+            insertIds.append(queryIds.at(queryIndex + i));
+    }
+    if (insertIds.isEmpty())
+        return 0;
+
+    m_contactRows[filter].clear();
+
+    const int end = index + insertIds.count() - 1;
     for (int i = 0; i < models.count(); ++i)
         models[i]->sourceAboutToInsertItems(index, end);
 
-    for (int i = 0; i < count; ++i) {
-        if (queryIds.at(queryIndex + i) == selfId)
-            continue;
+    if (filter == SeasideFilteredModel::FilterAll) {
+        for (int i = 0; i < insertIds.count(); ++i) {
+            m_expiredContacts[insertIds.at(i)] += 1;
 
-        if (filter == SeasideFilteredModel::FilterAll) {
-            m_expiredContacts[queryIds.at(queryIndex + i)] += 1;
-
-            addToContactNameGroup(nameGroupForCacheItem(cacheItemById(queryIds.at(queryIndex + i))), &modifiedNameGroups);
+            addToContactNameGroup(nameGroupForCacheItem(cacheItemById(insertIds.at(i))), &modifiedNameGroups);
         }
-
-        cacheIds.insert(index + i, queryIds.at(queryIndex + i));
     }
 
+    // Insert the whole range at once, so the tail of the list is moved only once.
+    cacheIds.insert(index, insertIds.count(), ContactIdType());
+    std::copy(insertIds.constBegin(), insertIds.constEnd(), cacheIds.begin() + index);
+
     for (int i = 0; i < models.count(); ++i)
         models[i]->sourceItemsInserted(index, end);
 
     notifyNameGroupsChanged(modifiedNameGroups);
 
-    return end - index + 1;
+    return insertIds.count();
+}
+
+int SeasideCache::moveRange(
+        SeasideFilteredModel::FilterType filter, int index, int count, int destination)
+{
+    QVector<ContactIdType> &cacheIds = m_contacts[filter];
+    QList<SeasideFilteredModel *> &models = m_models[filter];
+
+    m_contactRows[filter].clear();
+
+    // The contacts remain in the list, so their name groups and expiry are unaffected.
+    for (int i = 0; i < models.count(); ++i)
+        models[i]->sourceAboutToMoveItems(index, index + count - 1, destination);
+
+    const QVector<ContactIdType> movedIds = cacheIds.mid(index, count);
+    const int to = destination > index ? destination - count : destination;
+    cacheIds.remove(index, count);
+    cacheIds.insert(to, count, ContactIdType());
+    std::copy(movedIds.constBegin(), movedIds.constEnd(), cacheIds.begin() + to);
+
+    for (int i = 0; i < models.count(); ++i)
+        models[i]->sourceItemsMoved(index, index + count - 1, destination);
+
+    return destination < index ? count : 0;
+}
+
+void SeasideCache::appendPendingContacts()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // The lists share the time available, in a fixed order so that the models are populated
+    // in the same sequence however the results of the queries interleave.
+    bool pending = false;
+    for (int i = 0; i < populationFilterCount; ++i) {
+        const SeasideFilteredModel::FilterType filter = populationFilters[i];
+
+        appendPendingContacts(filter, elapsed);
+        if (!m_populationStages[filter].pendingRecords.isEmpty())
+            pending = true;
+    }
+
+    if (pending) {
+        m_populationTimer.start(0, this);
+    } else {
+        m_populationTimer.stop();
+    }
+
+    populationStageFinished();
 }
 
-void SeasideCache::appendContacts(const QList<QContact> &contacts)
+void SeasideCache::appendPendingContacts(
+        SeasideFilteredModel::FilterType filter, const QElapsedTimer &elapsed)
 {
-    if (!contacts.isEmpty()) {
-        QVector<ContactIdType> &cacheIds = m_contacts[m_fetchFilter];
-        QList<SeasideFilteredModel *> &models = m_models[m_fetchFilter];
+    // The first screenful of a list is always inserted in a single batch.
+    static const int InitialPopulationCount = 20;
+
+    PopulationStage &stage = m_populationStages[filter];
+    QVector<ContactIdType> &cacheIds = m_contacts[filter];
+    QList<SeasideFilteredModel *> &models = m_models[filter];
+    QList<QChar> modifiedGroups;
 
-        cacheIds.reserve(contacts.count());
+    const int minimumCount = cacheIds.isEmpty() ? InitialPopulationCount : 1;
 
+    QVector<ContactIdType> appendedIds;
+    while (!stage.pendingRecords.isEmpty()
+            && (appendedIds.count() < minimumCount || elapsed.elapsed() < m_populationBudget)) {
+        const ContactRecord record = stage.pendingRecords.takeFirst();
+
+        appendedIds.append(record.id);
+        SeasideCacheItem &cacheItem = m_people[record.iid];
+        updateSummary(&cacheItem, record);
+
+        // Only retain the complete contact if it has been requested; otherwise the
+        // summary is sufficient to represent the contact in a list.
+        if (cacheItem.hasCompleteContact && stage.profile == CompleteProfile) {
+            cacheItem.contact = record.contact;
+            retainCompleteContact(record.iid, &cacheItem);
+        }
+
+        if (filter == SeasideFilteredModel::FilterAll)
+            addToContactNameGroup(nameGroupForCacheItem(&cacheItem), &modifiedGroups);
+    }
+
+    if (!appendedIds.isEmpty()) {
         const int begin = cacheIds.count();
-        int end = cacheIds.count() + contacts.count() - m_appendIndex - 1;
+        const int end = begin + appendedIds.count() - 1;
+
+        for (int i = 0; i < models.count(); ++i)
+            models.at(i)->sourceAboutToInsertItems(begin, end);
+
+        cacheIds += appendedIds;
 
-        if (begin <= end) {
-            for (int i = 0; i < models.count(); ++i)
-                models.at(i)->sourceAboutToInsertItems(begin, end);
+        for (int i = 0; i < models.count(); ++i)
+            models.at(i)->sourceItemsInserted(begin, end);
 
-            for (; m_appendIndex < contacts.count(); ++m_appendIndex) {
-                QContact contact = contacts.at(m_appendIndex);
-                ContactIdType apiId = SeasideFilteredModel::apiId(contact);
-                quint32 iid = SeasideFilteredModel::internalId(contact);
+        notifyNameGroupsChanged(modifiedGroups);
+    }
+}
 
-                cacheIds.append(apiId);
-                SeasideCacheItem &cacheItem = m_people[iid];
-                cacheItem.contact = contact;
-                cacheItem.filterKey = QStringList();
+void SeasideCache::populationStageFinished()
+{
+    // A list is reported as populated once its query has finished and all of its results
+    // have been inserted, but not before the lists preceding it.
+    for (int i = 0; i < populationFilterCount; ++i) {
+        const SeasideFilteredModel::FilterType filter = populationFilters[i];
+        PopulationStage &stage = m_populationStages[filter];
 
-                if (m_fetchFilter == SeasideFilteredModel::FilterAll)
-                    addToContactNameGroup(nameGroupForCacheItem(&cacheItem), 0);
+        if (isPopulated(filter))
+            continue;
+        if (stage.fetching || !stage.pendingRecords.isEmpty() || isProcessing(filter))
+            return;
+
+        if (stage.paged) {
+            stage.paged = false;
+            stage.pagedIds.clear();
+            stage.pagedRows.clear();
+            stage.requestedPages.clear();
+            stage.priorityPages.clear();
+        }
 
-                foreach (const QContactPhoneNumber &phoneNumber, contact.details<QContactPhoneNumber>()) {
-                    QString normalizedNumber = Normalization::normalizePhoneNumber(phoneNumber.number());
-                    m_phoneNumberIds[normalizedNumber] = iid;
-                }
+        if (filter == SeasideFilteredModel::FilterFavorites) {
+            qDebug() << "Favorites queried in" << m_timer.elapsed() << "ms";
+            makePopulated(filter);
+        } else if (filter == SeasideFilteredModel::FilterOnline) {
+            qDebug() << "Online queried in" << m_timer.elapsed() << "ms";
+            makePopulated(filter);
+        } else {
+            qDebug() << "All queried in" << m_timer.elapsed() << "ms";
+            makePopulated(SeasideFilteredModel::FilterNone);
+            makePopulated(SeasideFilteredModel::FilterAll);
+
+            // The favorites were queried ahead of the all list, changes to them since are
+            // reconciled here.
+            for (int j = 0; j < derivedFilterCount; ++j) {
+                synchronizeDerivedList(derivedFilters[j]);
+                if (!isPopulated(derivedFilters[j]))
+                    makePopulated(derivedFilters[j]);
+            }
+
+            if (m_updatesPending) {
+                // Apply any changes reported while the lists were being populated.
+                QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
             }
+        }
+    }
+}
+
+void SeasideCache::synchronizeDerivedList(SeasideFilteredModel::FilterType filter)
+{
+    const QVector<ContactIdType> &allIds = m_contacts[SeasideFilteredModel::FilterAll];
+
+    QList<ContactIdType> contactIds;
+    for (int i = 0; i < allIds.count(); ++i) {
+        CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(
+                SeasideFilteredModel::internalId(allIds.at(i)));
+        if (it != m_people.constEnd() && isDerivedMember(filter, *it))
+            contactIds.append(allIds.at(i));
+    }
 
-            for (int i = 0; i < models.count(); ++i)
-                models.at(i)->sourceItemsInserted(begin, end);
+    const SeasideFilteredModel::FilterType fetchFilter = m_fetchFilter;
 
-            if (!m_nameGroupChangeListeners.isEmpty())
-                notifyNameGroupsChanged(m_contactNameGroups.keys());
+    m_fetchFilter = filter;
+    m_cacheIndex = 0;
+    m_queryIndex = 0;
+    synchronizeList(this, m_contacts[filter], m_cacheIndex, contactIds, m_queryIndex);
+    finalizeUpdate(filter, contactIds);
+
+    m_fetchFilter = fetchFilter;
+}
+
+void SeasideCache::updateDerivedList(
+        SeasideFilteredModel::FilterType filter, const QSet<ContactIdType> &contactIds)
+{
+    const QVector<ContactIdType> &allIds = m_contacts[SeasideFilteredModel::FilterAll];
+    const QVector<ContactIdType> &derivedIds = m_contacts[filter];
+
+    // The derived list is ordered like the all list, so the changed contacts are found in a
+    // single pass over the all list.  Consecutive insertions or removals are applied together.
+    QList<ContactIdType> insertIds;
+    int removeCount = 0;
+    int row = 0;
+    int remaining = contactIds.count();
+
+    for (int i = 0; i < allIds.count() && remaining > 0; ++i) {
+        const ContactIdType &contactId = allIds.at(i);
+        const int position = row + removeCount;
+        const bool listed = position < derivedIds.count() && derivedIds.at(position) == contactId;
+
+        bool member = listed;
+        if (contactIds.contains(contactId)) {
+            --remaining;
+            CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(
+                    SeasideFilteredModel::internalId(contactId));
+            member = it != m_people.constEnd() && isDerivedMember(filter, *it);
+        }
+
+        if (listed && !member) {
+            if (!insertIds.isEmpty()) {
+                row += insertRange(filter, row, insertIds.count(), insertIds, 0);
+                insertIds.clear();
+            }
+            ++removeCount;
+        } else if (!listed && member) {
+            if (removeCount > 0) {
+                removeRange(filter, row, removeCount);
+                removeCount = 0;
+            }
+            insertIds.append(contactId);
+        } else if (listed) {
+            if (!insertIds.isEmpty()) {
+                row += insertRange(filter, row, insertIds.count(), insertIds, 0);
+                insertIds.clear();
+            }
+            if (removeCount > 0) {
+                removeRange(filter, row, removeCount);
+                removeCount = 0;
+            }
+            ++row;
         }
     }
+
+    if (!insertIds.isEmpty())
+        insertRange(filter, row, insertIds.count(), insertIds, 0);
+    if (removeCount > 0)
+        removeRange(filter, row, removeCount);
 }
 
 void SeasideCache::requestStateChanged(QContactAbstractRequest::State state)
@@ -992,7 +2545,62 @@ void SeasideCache::requestStateChanged(QContactAbstractRequest::State state)
 
     QContactAbstractRequest *request = static_cast<QContactAbstractRequest *>(sender());
 
-    if (request == &m_relationshipsFetchRequest) {
+    for (int i = 0; i < populationFilterCount; ++i) {
+        PopulationStage &stage = m_populationStages[populationFilters[i]];
+        if (request == &stage.request) {
+            if (stage.request.error() != QContactManager::NoError)
+                qWarning() << "Unable to populate contact list:" << stage.request.error();
+
+            if (stage.paged) {
+                fetchNextPage();
+                return;
+            }
+
+            stage.fetching = false;
+
+            // Results still being inserted are accounted for once they have been.
+            populationStageFinished();
+            return;
+        }
+    }
+
+    if (request == &m_contactIdRequest && m_populationStages[SeasideFilteredModel::FilterAll].fetchingIds) {
+        pagedIdsAvailable();
+        return;
+    }
+
+    if (request == &m_removedIdRequest) {
+        if (m_removedIdRequest.error() != QContactManager::NoError) {
+            // The removals can't be identified; read the lists again instead.
+            qWarning() << "Unable to fetch removals since last sync:" << m_removedIdRequest.error();
+            m_refreshRequired = true;
+        } else if (!m_removedIdRequest.ids().isEmpty()) {
+            contactsRemoved(m_removedIdRequest.ids());
+        }
+
+        const QContactChangeLogFilter removedFilter(m_removedIdRequest.filter());
+
+        QContactChangeLogFilter addedFilter;
+        addedFilter.setEventType(QContactChangeLogFilter::EventAdded);
+        addedFilter.setSince(removedFilter.since());
+
+        QContactChangeLogFilter changedFilter;
+        changedFilter.setEventType(QContactChangeLogFilter::EventChanged);
+        changedFilter.setSince(removedFilter.since());
+
+        startFetch((addedFilter | changedFilter) & aggregateFilter(), ListProfile);
+        return;
+    }
+
+    RequestType type = RefreshRequest;
+    if (request == &m_removeRequest) {
+        type = RemoveRequest;
+    } else if (request == &m_saveRequest) {
+        type = SaveRequest;
+    } else if (request == &m_completionRequest) {
+        type = CompletionRequest;
+    } else if (request == &m_relationshipsFetchRequest) {
+        type = ConstituentRequest;
         if (m_constituentIds.isEmpty()) {
             // We didn't find any constituents - report the empty list
             QContactId aggregateId = m_contactsToFetchConstituents.takeFirst();
@@ -1005,6 +2613,7 @@ void SeasideCache::requestStateChanged(QContactAbstractRequest::State state)
             emit person->constituentsChanged();
         }
     } else if (request == &m_fetchByIdRequest) {
+        type = ConstituentRequest;
         if (!m_constituentIds.isEmpty()) {
             // Report these results
             QContactId aggregateId = m_contactsToFetchConstituents.takeFirst();
@@ -1023,60 +2632,314 @@ void SeasideCache::requestStateChanged(QContactAbstractRequest::State state)
             person->setConstituents(constituentIds);
             emit person->constituentsChanged();
         }
+    } else if (request == &m_fetchRequest) {
+        type = ChangeRequest;
     }
 
-    if (m_fetchFilter == SeasideFilteredModel::FilterFavorites) {
-        // Next, query for all contacts
-        m_fetchFilter = SeasideFilteredModel::FilterAll;
+    if (request == &m_fetchRequest && m_fetchingDelta) {
+        m_fetchingDelta = false;
 
-        if (!isPopulated(SeasideFilteredModel::FilterFavorites)) {
-            qDebug() << "Favorites queried in" << m_timer.elapsed() << "ms";
-            m_appendIndex = 0;
-            m_fetchRequest.setFilter(QContactFilter());
-            m_fetchRequest.start();
-            makePopulated(SeasideFilteredModel::FilterFavorites);
-        } else {
-            finalizeUpdate(SeasideFilteredModel::FilterFavorites);
-            m_contactIdRequest.setFilter(QContactFilter());
-            m_contactIdRequest.start();
-        }
-    } else if (m_fetchFilter == SeasideFilteredModel::FilterAll) {
-        // Next, query for online contacts
-        m_fetchFilter = SeasideFilteredModel::FilterOnline;
+        if (m_fetchRequest.error() != QContactManager::NoError) {
+            // The backend could not report the changes since the cache was last in sync, so
+            // every contact held must be fetched again.
+            qWarning() << "Unable to fetch changes since last sync:" << m_fetchRequest.error();
 
-        if (!isPopulated(SeasideFilteredModel::FilterAll)) {
-            qDebug() << "All queried in" << m_timer.elapsed() << "ms";
-            // Not correct, but better than nothing...
-            m_appendIndex = 0;
-            m_fetchRequest.setFilter(QContactGlobalPresence::match(QContactPresence::PresenceAvailable));
-            m_fetchRequest.start();
-            makePopulated(SeasideFilteredModel::FilterNone);
-            makePopulated(SeasideFilteredModel::FilterAll);
-        } else {
-            finalizeUpdate(SeasideFilteredModel::FilterAll);
-            m_contactIdRequest.setFilter(QContactGlobalPresence::match(QContactPresence::PresenceAvailable));
-            m_contactIdRequest.start();
+            typedef CacheItemTable<SeasideCacheItem>::iterator iterator;
+            for (iterator it = m_people.begin(); it != m_people.end(); ++it)
+                m_changedContacts.insert(it->apiId());
+            m_refreshRequired = true;
+        } else if (!m_refreshRequired) {
+            // Added contacts are positioned in the lists by reading them again.
+            const QHash<quint32, int> &allRows = contactRows(SeasideFilteredModel::FilterAll);
+            const ContactIdType selfId = m_manager.selfContactId();
+            foreach (const QContact &contact, m_fetchRequest.contacts()) {
+                const ContactIdType apiId = SeasideFilteredModel::apiId(contact);
+                if (apiId != selfId && !allRows.contains(SeasideFilteredModel::internalId(apiId))) {
+                    m_refreshRequired = true;
+                    break;
+                }
+            }
         }
-    } else if (m_fetchFilter == SeasideFilteredModel::FilterOnline) {
-        m_fetchFilter = SeasideFilteredModel::FilterNone;
+    }
 
-        if (m_updatesPending) {
-            QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
-        }
+    if (isProcessing(SeasideFilteredModel::FilterNone)) {
+        // Results of this fetch are still being prepared, continue once they have been applied.
+        m_requestLanes[type].awaitingRecords = true;
+        return;
+    }
 
-        if (!isPopulated(SeasideFilteredModel::FilterOnline)) {
-            qDebug() << "Online queried in" << m_timer.elapsed() << "ms";
-            m_fetchRequest.setFetchHint(QContactFetchHint());
-            makePopulated(SeasideFilteredModel::FilterOnline);
-        } else {
-            finalizeUpdate(SeasideFilteredModel::FilterOnline);
-        }
-    } else if (m_fetchFilter == SeasideFilteredModel::FilterNone) {
-        // Result of a specific query
-        if (m_updatesPending) {
-            QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
+    finishRequest(type);
+}
+
+void SeasideCache::fetchStageFinished()
+{
+    m_fetchFilter = SeasideFilteredModel::FilterNone;
+
+    finalizeUpdate(SeasideFilteredModel::FilterAll);
+
+    // The remaining lists follow from the content of the all list.
+    for (int i = 0; i < derivedFilterCount; ++i)
+        synchronizeDerivedList(derivedFilters[i]);
+}
+
+void SeasideCache::scheduleSnapshot()
+{
+    static const int SnapshotDelayMs = 10000;
+
+    if (!m_snapshotTimer.isActive())
+        m_snapshotTimer.start(SnapshotDelayMs, this);
+}
+
+bool SeasideCache::loadSnapshot()
+{
+    QFile file(snapshotPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    uchar *data = size > SnapshotHeaderSize ? file.map(0, size) : 0;
+    if (!data)
+        return false;
+
+    // Everything restored is copied out of the mapping, so it can be released immediately.
+    const bool restored = restoreSnapshot(QByteArray::fromRawData(reinterpret_cast<const char *>(data), size));
+    file.unmap(data);
+
+    if (!restored) {
+        qWarning() << "Discarding invalid contact cache snapshot" << file.fileName();
+        file.remove();
+    }
+    return restored;
+}
+
+// Writes the snapshot data to a temporary file and renames it over the previous snapshot, so
+// that other processes never map a partially written file.
+static void saveSnapshot(const QString &path, const QByteArray &data)
+{
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        qWarning() << "Unable to create contact cache snapshot directory for" << path;
+        return;
+    }
+
+    // The snapshot holds contact details, so it is readable by its owner only.
+    QFile file(path + QLatin1String(".tmp.") + QString::number(QCoreApplication::applicationPid()));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || !file.setPermissions(QFile::ReadOwner | QFile::WriteOwner)) {
+        qWarning() << "Unable to write contact cache snapshot" << file.fileName();
+        file.remove();
+        return;
+    }
+
+    const bool written = file.write(data) == data.size();
+    file.close();
+
+    if (!written || std::rename(QFile::encodeName(file.fileName()).constData(), QFile::encodeName(path).constData()) != 0) {
+        qWarning() << "Unable to write contact cache snapshot" << path;
+        file.remove();
+    }
+}
+
+void SeasideCache::writeSnapshot()
+{
+    if (!isPopulated(SeasideFilteredModel::FilterAll) || !m_syncWatermark.isValid())
+        return;
+
+    // The temporary file is reused, so only one snapshot is written at a time.
+    if (m_snapshotWrite.isRunning()) {
+        scheduleSnapshot();
+        return;
+    }
+
+    // The cache is only serialized here; the file is written by another thread.
+    m_snapshotWrite = QtConcurrent::run(saveSnapshot, snapshotPath(), snapshotData());
+}
+
+QByteArray SeasideCache::snapshotData() const
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_7);
+
+    const BackendState state = backendState(m_manager.managerName());
+    stream << m_manager.managerUri() << qint32(m_displayLabelOrder) << m_syncWatermark
+           << state.device << state.inode << state.modified;
+
+    typedef CacheItemTable<SeasideCacheItem>::const_iterator iterator;
+    quint32 count = 0;
+    for (iterator it = m_people.begin(); it != m_people.end(); ++it) {
+        // Placeholders for contacts which have never been fetched have no summary.
+        if (!it->nameGroup.isNull())
+            ++count;
+    }
+
+    stream << count;
+    for (iterator it = m_people.begin(); it != m_people.end(); ++it) {
+        if (it->nameGroup.isNull())
+            continue;
+
+        stream << it.key()
+               << it->firstName
+               << it->lastName
+               << it->displayLabel
+               << it->avatarUrl
+               << it->nameGroup
+               << qint32(it->presenceState)
+               << it->favorite
+               << it->filterKey;
+    }
+
+    for (unsigned i = 0; i < sizeof(snapshotFilters) / sizeof(snapshotFilters[0]); ++i) {
+        const QVector<ContactIdType> &contactIds = m_contacts[snapshotFilters[i]];
+
+        QVector<quint32> iids;
+        iids.reserve(contactIds.count());
+        for (int j = 0; j < contactIds.count(); ++j)
+            iids.append(SeasideFilteredModel::internalId(contactIds.at(j)));
+
+        stream << iids;
+    }
+
+    stream << m_phoneNumberIds << m_contactNameGroups;
+
+    QByteArray data;
+    QDataStream header(&data, QIODevice::WriteOnly);
+    header.setVersion(QDataStream::Qt_4_7);
+    header << SnapshotMagic
+           << SnapshotVersion
+           << qChecksum(payload.constData(), payload.size())
+           << quint32(payload.size());
+
+    data.append(payload);
+    return data;
+}
+
+struct SeasideCache::Snapshot
+{
+    QDateTime watermark;
+    CacheItemTable<SeasideCacheItem> people;
+    QVector<quint32> iids[SeasideFilteredModel::FilterTypesCount];
+    QHash<QString, quint32> phoneNumberIds;
+    QHash<QChar, int> contactNameGroups;
+};
+
+bool SeasideCache::readSnapshot(const QByteArray &data, Snapshot *snapshot)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_4_7);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint16 checksum = 0;
+    quint32 size = 0;
+    stream >> magic >> version >> checksum >> size;
+
+    if (stream.status() != QDataStream::Ok
+            || magic != SnapshotMagic
+            || version != SnapshotVersion
+            || size != quint32(data.size() - SnapshotHeaderSize)
+            || checksum != qChecksum(data.constData() + SnapshotHeaderSize, size)) {
+        return false;
+    }
+
+    QString managerUri;
+    qint32 displayLabelOrder = 0;
+    BackendState snapshotState;
+    stream >> managerUri >> displayLabelOrder >> snapshot->watermark
+           >> snapshotState.device >> snapshotState.inode >> snapshotState.modified;
+
+    // The snapshot is only usable if it was produced from the same backend with the same
+    // sort order.
+    if (managerUri != m_manager.managerUri()
+            || displayLabelOrder != m_displayLabelOrder
+            || !snapshot->watermark.isValid()) {
+        return false;
+    }
+
+    // Changes made to the database since the snapshot are fetched from its change log, but a
+    // database replaced, or restored to an earlier state, has a log which doesn't follow on.
+    const BackendState state = backendState(m_manager.managerName());
+    if (state.device != snapshotState.device
+            || state.inode != snapshotState.inode
+            || state.modified < snapshotState.modified) {
+        return false;
+    }
+
+    quint32 count = 0;
+    stream >> count;
+
+    snapshot->people.reserve(count);
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        quint32 iid = 0;
+        qint32 presenceState = 0;
+        SeasideCacheItem item;
+
+        stream >> iid
+               >> item.firstName
+               >> item.lastName
+               >> item.displayLabel
+               >> item.avatarUrl
+               >> item.nameGroup
+               >> presenceState
+               >> item.favorite
+               >> item.filterKey;
+
+        item.id = SeasideFilteredModel::apiId(iid);
+        item.firstName = m_stringPool.intern(item.firstName);
+        item.lastName = m_stringPool.intern(item.lastName);
+        item.displayLabel = m_stringPool.intern(item.displayLabel);
+        m_stringPool.intern(&item.filterKey);
+        item.presenceState = QContactPresence::PresenceState(presenceState);
+        snapshot->people.insert(iid, item);
+    }
+
+    for (unsigned i = 0; i < sizeof(snapshotFilters) / sizeof(snapshotFilters[0]); ++i)
+        stream >> snapshot->iids[snapshotFilters[i]];
+
+    stream >> snapshot->phoneNumberIds >> snapshot->contactNameGroups;
+
+    // Each contact holds the numbers resolving to it, so they can be removed with it.
+    typedef QHash<QString, quint32>::const_iterator phone_iterator;
+    for (phone_iterator it = snapshot->phoneNumberIds.constBegin(); it != snapshot->phoneNumberIds.constEnd(); ++it) {
+        CacheItemTable<SeasideCacheItem>::iterator item = snapshot->people.find(*it);
+        if (item != snapshot->people.end())
+            item->phoneNumbers.append(it.key());
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool SeasideCache::restoreSnapshot(const QByteArray &data)
+{
+    Snapshot snapshot;
+    if (!readSnapshot(data, &snapshot))
+        return false;
+
+    m_people = snapshot.people;
+
+    m_searchIndex.clear();
+    typedef CacheItemTable<SeasideCacheItem>::const_iterator iterator;
+    for (iterator it = m_people.begin(); it != m_people.end(); ++it)
+        m_searchIndex.insert(it.key(), it->filterKey);
+
+    for (unsigned i = 0; i < sizeof(snapshotFilters) / sizeof(snapshotFilters[0]); ++i) {
+        const QVector<quint32> &iids = snapshot.iids[snapshotFilters[i]];
+        QVector<ContactIdType> &contactIds = m_contacts[snapshotFilters[i]];
+        contactIds.clear();
+        m_contactRows[snapshotFilters[i]].clear();
+        contactIds.reserve(iids.count());
+
+        for (int j = 0; j < iids.count(); ++j) {
+            CacheItemTable<SeasideCacheItem>::const_iterator it = m_people.constFind(iids.at(j));
+            contactIds.append(it != m_people.constEnd()
+                    ? it->id
+                    : SeasideFilteredModel::apiId(iids.at(j)));
         }
     }
+    m_phoneNumberIds = snapshot.phoneNumberIds;
+    m_contactNameGroups = snapshot.contactNameGroups;
+    m_deltaSince = snapshot.watermark;
+
+    return true;
 }
 
 void SeasideCache::makePopulated(SeasideFilteredModel::FilterType filter)
@@ -1112,23 +2975,31 @@ void SeasideCache::displayLabelOrderChanged()
 
         m_fetchRequest.setSorting(sorting);
         m_contactIdRequest.setSorting(sorting);
+        for (int i = 0; i < populationFilterCount; ++i)
+            m_populationStages[populationFilters[i]].request.setSorting(sorting);
 
-        typedef QHash<quint32, SeasideCacheItem>::iterator iterator;
+        typedef CacheItemTable<SeasideCacheItem>::iterator iterator;
         for (iterator it = m_people.begin(); it != m_people.end(); ++it) {
             if (it->person) {
                 it->person->recalculateDisplayLabel(SeasideFilteredModel::DisplayLabelOrder(m_displayLabelOrder));
                 it->contact = it->person->contact();
+                it->displayLabel = m_stringPool.intern(it->person->displayLabel());
+                it->nameGroup = determineNameGroup(*it, it->contact);
             } else {
-                QContactName name = it->contact.detail<QContactName>();
-#ifdef USING_QTPIM
-                name.setValue(QContactName__FieldCustomLabel, SeasidePerson::generateDisplayLabel(it->contact));
-#else
-                name.setCustomLabel(SeasidePerson::generateDisplayLabel(it->contact));
-#endif
-                it->contact.saveDetail(&name);
+                QContact contact = summaryContact(*it);
+                it->displayLabel = m_stringPool.intern(SeasidePerson::generateDisplayLabel(
+                        contact, SeasideFilteredModel::DisplayLabelOrder(m_displayLabelOrder)));
+                it->nameGroup = determineNameGroup(*it, contact);
             }
         }
 
+        // The name groups depend on the display label order, so recount them.
+        m_contactNameGroups.clear();
+        const QVector<ContactIdType> &allIds = m_contacts[SeasideFilteredModel::FilterAll];
+        for (int i = 0; i < allIds.count(); ++i)
+            addToContactNameGroup(nameGroupForCacheItem(cacheItemById(allIds.at(i))), 0);
+        notifyNameGroupsChanged(allContactNameGroups);
+
         for (int i = 0; i < SeasideFilteredModel::FilterTypesCount; ++i) {
             for (int j = 0; j < m_models[i].count(); ++j)
                 m_models[i].at(j)->updateDisplayLabelOrder();
@@ -1176,11 +3047,11 @@ QString SeasideCache::exportContacts()
 
     const quint32 selfId = SeasideFilteredModel::internalId(instance->m_manager.selfContactId());
 
-    typedef QHash<quint32, SeasideCacheItem>::iterator iterator;
+    typedef CacheItemTable<SeasideCacheItem>::iterator iterator;
     for (iterator it = instance->m_people.begin(); it != instance->m_people.end(); ++it) {
         if (it.key() == selfId) {
             continue;
-        } else if (it->hasCompleteContact) {
+        } else if (it->hasCompleteContact && !it->contact.isEmpty()) {
             contacts.append(it->contact);
         } else {
             contactsToFetch.append(SeasideFilteredModel::apiId(it.key()));
@@ -39,6 +39,7 @@
 #include <QContactRemoveRequest>
 #include <QContactSaveRequest>
 #include <QContactRelationshipFetchRequest>
+#include <QContactPresence>
 #ifdef USING_QTPIM
 #include <QContactIdFilter>
 #include <QContactIdFetchRequest>
@@ -48,26 +49,61 @@
 #endif
 
 #include <QBasicTimer>
+#include <QBitArray>
+#include <QDateTime>
+#include <QFutureWatcher>
 #include <QSet>
+#include <QUrl>
+#include <QVariantMap>
 
 #include <QElapsedTimer>
+#include <QLinkedList>
 
 #ifdef HAS_MLITE
 #include <mgconfitem.h>
 #endif
 
 #include "seasidefilteredmodel.h"
+#include "cacheitemtable_p.h"
+#include "contactrecord_p.h"
+#include "prefixindex_p.h"
+#include "stringpool_p.h"
+#include "synchronizelists_p.h"
 
 struct SeasideCacheItem
 {
-    SeasideCacheItem() : person(0), hasCompleteContact(false) {}
-    SeasideCacheItem(const QContact &contact) : contact(contact), person(0), hasCompleteContact(false) {}
-
-    SeasideFilteredModel::ContactIdType apiId() const { return SeasideFilteredModel::apiId(contact); }
-
+    SeasideCacheItem()
+        : id()
+        , presenceState(QContactPresence::PresenceUnknown)
+        , favorite(false)
+        , person(0)
+        , completeSize(0)
+        , hasCompleteContact(false)
+    {}
+
+    SeasideFilteredModel::ContactIdType apiId() const { return id; }
+
+    // Summary of the contact; this is all that is retained for contacts which are only
+    // displayed in a list.
+    SeasideFilteredModel::ContactIdType id;
+    QString firstName;
+    QString lastName;
+    QString displayLabel;
+    QUrl avatarUrl;
+    QChar nameGroup;
+    QContactPresence::PresenceState presenceState;
+    bool favorite;
+
+    // The complete contact, only held once a person has been requested for the item.
     QContact contact;
     SeasidePerson *person;
     QStringList filterKey;
+    QStringList phoneNumbers;   // Normalized, those resolving to the contact.
+
+    // The position of a complete contact not held by a person among the others, and its
+    // estimated size; zero while it is not among them.
+    QLinkedList<quint32>::iterator completeUsage;
+    int completeSize;
     bool hasCompleteContact;
 };
 
@@ -100,6 +136,7 @@ public:
     static int contactId(const QContact &contact);
 
     static SeasideCacheItem *cacheItemById(const ContactIdType &id);
+    static SeasideCacheItem *displayedItemById(const ContactIdType &id);
     static SeasidePerson *personById(const ContactIdType &id);
 #ifdef USING_QTPIM
     static SeasidePerson *personById(int id);
@@ -107,6 +144,10 @@ public:
     static SeasidePerson *selfPerson();
     static QContact contactById(const ContactIdType &id);
     static QChar nameGroupForCacheItem(SeasideCacheItem *cacheItem);
+    static QChar determineNameGroup(
+            const QContact &contact,
+            SeasideFilteredModel::DisplayLabelOrder order,
+            const QString &personDisplayLabel = QString());
     static QList<QChar> allNameGroups();
     static QHash<QChar, int> nameGroupCounts();
 
@@ -123,6 +164,17 @@ public:
 
     static const QVector<ContactIdType> *contacts(SeasideFilteredModel::FilterType filterType);
     static bool isPopulated(SeasideFilteredModel::FilterType filterType);
+    static bool matchContacts(
+            SeasideFilteredModel::FilterType filterType,
+            const QStringList &prefixes,
+            QVector<ContactIdType> *contactIds);
+
+    static QVariantMap memoryStatistics();
+    static QVariantMap lookupStatistics();
+    static void resetLookupStatistics();
+    static QVariantMap requestStatistics();
+    static QVariantMap coalescingStatistics();
+    static void resetCoalescingStatistics();
 
     bool event(QEvent *event);
 
@@ -130,6 +182,8 @@ public:
     int insertRange(int index, int count, const QList<ContactIdType> &source, int sourceIndex) {
         return insertRange(m_fetchFilter, index, count, source, sourceIndex); }
     int removeRange(int index, int count) { removeRange(m_fetchFilter, index, count); return 0; }
+    int moveRange(int index, int count, int destination) {
+        return moveRange(m_fetchFilter, index, count, destination); }
 
 protected:
     void timerEvent(QTimerEvent *event);
@@ -151,18 +205,130 @@ private slots:
     void updateContacts(const QList<QContactLocalId> &contactIds);
 #endif
     void displayLabelOrderChanged();
+    void recordsProcessed();
 
 private:
+    enum FetchProfile {
+        ListProfile,
+        CompleteProfile
+    };
+
+    // An initial query for the contacts of one list, run alongside those of the others.
+    struct PopulationStage
+    {
+        PopulationStage()
+            : appendIndex(0), nextPage(0), pageRun(1), profile(ListProfile)
+            , fetching(false), paged(false), fetchingIds(false) {}
+
+        QContactFetchRequest request;
+        QList<ContactRecord> pendingRecords;
+        int appendIndex;
+
+        // A paged stage fetches the ordered ids of the list first, and then the contacts
+        // in pages, those containing rows being displayed first.
+        QList<ContactIdType> pagedIds;
+        QHash<quint32, int> pagedRows;
+        QBitArray requestedPages;
+        QList<int> priorityPages;
+        int nextPage;
+        int pageRun;
+
+        FetchProfile profile;
+        bool fetching;
+        bool paged;
+        bool fetchingIds;
+    };
+
+    // The kinds of work sent to the backend, each with a request of its own so that they
+    // may run concurrently.
+    enum RequestType {
+        RemoveRequest,
+        SaveRequest,
+        CompletionRequest,
+        ConstituentRequest,
+        ChangeRequest,
+        RefreshRequest,
+        RequestTypesCount
+    };
+
+    struct RequestLane
+    {
+        RequestLane() : completed(0), resultsRead(0), active(false), awaitingRecords(false) {}
+
+        QElapsedTimer queued;
+        QElapsedTimer started;
+        QVector<int> latencies;
+        int completed;
+        int resultsRead;
+        bool active;
+        bool awaitingRecords;
+    };
+
+    // Fetched contacts being prepared away from the GUI thread, for a population stage or,
+    // with FilterNone, for an update.
+    struct ProcessingBatch
+    {
+        QFutureWatcher<QList<ContactRecord> > *watcher;
+        SeasideFilteredModel::FilterType filter;
+        FetchProfile profile;
+    };
+
     SeasideCache();
     ~SeasideCache();
 
     static void checkForExpiry();
 
+    static QContact summaryContact(const SeasideCacheItem &item);
+    static QChar determineNameGroup(const SeasideCacheItem &item, const QContact &contact);
+
+    void updateSummary(SeasideCacheItem *item, const ContactRecord &record);
+    void removePhoneNumbers(quint32 iid, const QStringList &phoneNumbers);
+    void retainCompleteContact(quint32 iid, SeasideCacheItem *item);
+    void releaseCompleteContact(SeasideCacheItem *item);
+    void demoteCompleteContacts();
+
     void requestUpdate();
-    void appendContacts(const QList<QContact> &contacts);
+    void markQueuedRequests();
+    bool hasRequestWork(RequestType type) const;
+    qint64 requestPriority(RequestType type) const;
+    void startRequest(RequestType type);
+    void finishRequest(RequestType type);
+    void updatesCompleted();
+    void scheduleSnapshot();
+    bool loadSnapshot();
+    void writeSnapshot();
+    QByteArray snapshotData() const;
+    struct Snapshot;
+    bool readSnapshot(const QByteArray &data, Snapshot *snapshot);
+    bool restoreSnapshot(const QByteArray &data);
+    void startPopulation();
+    void processContacts(
+            SeasideFilteredModel::FilterType filter,
+            const QList<QContact> &contacts,
+            FetchProfile profile);
+    bool isProcessing(SeasideFilteredModel::FilterType filter) const;
+    void applyRecords(
+            SeasideFilteredModel::FilterType filter,
+            const QList<ContactRecord> &records,
+            FetchProfile profile);
+    void applyUpdates(const QList<ContactRecord> &records, FetchProfile profile);
+    void appendPendingContacts();
+    void appendPendingContacts(SeasideFilteredModel::FilterType filter, const QElapsedTimer &elapsed);
+    void populationStageFinished();
+    void synchronizeDerivedList(SeasideFilteredModel::FilterType filter);
+    void updateDerivedList(
+            SeasideFilteredModel::FilterType filter, const QSet<ContactIdType> &contactIds);
+    void pagedIdsAvailable();
+    void prioritizePage(quint32 iid);
+    void fetchNextPage();
+    void appendPage(const QList<ContactRecord> &records);
+    static QContactFetchHint fetchHint(FetchProfile profile);
+    void startFetch(const QContactFilter &filter, FetchProfile profile);
     void fetchContacts();
 
+    void fetchStageFinished();
     void finalizeUpdate(SeasideFilteredModel::FilterType filter);
+    void finalizeUpdate(SeasideFilteredModel::FilterType filter, const QList<ContactIdType> &queryIds);
     void removeRange(SeasideFilteredModel::FilterType filter, int index, int count);
     int insertRange(
             SeasideFilteredModel::FilterType filter,
@@ -170,9 +336,12 @@ private:
             int count,
             const QList<ContactIdType> &queryIds,
             int queryIndex);
+    int moveRange(SeasideFilteredModel::FilterType filter, int index, int count, int destination);
 
     void updateContactData(const ContactIdType &contactId, SeasideFilteredModel::FilterType filter);
     void removeContactData(const ContactIdType &contactId, SeasideFilteredModel::FilterType filter);
+    void removeContacts(SeasideFilteredModel::FilterType filter, const QSet<ContactIdType> &contactIds);
+    const QHash<quint32, int> &contactRows(SeasideFilteredModel::FilterType filter);
     void makePopulated(SeasideFilteredModel::FilterType filter);
 
     void addToContactNameGroup(const QChar &group, QList<QChar> *modifiedGroups = 0);
@@ -181,26 +350,39 @@ private:
 
     QBasicTimer m_expiryTimer;
     QBasicTimer m_fetchTimer;
-    QHash<quint32, SeasideCacheItem> m_people;
+    QBasicTimer m_snapshotTimer;
+    QBasicTimer m_populationTimer;
+    QFuture<void> m_snapshotWrite;
+    CacheItemTable<SeasideCacheItem> m_people;
+    QLinkedList<quint32> m_completeContacts;    // Least recently used first.
+    StringPool m_stringPool;
+    PrefixIndex m_searchIndex;
     QHash<QString, quint32> m_phoneNumberIds;
     QHash<ContactIdType, QContact> m_contactsToSave;
     QHash<QChar, int> m_contactNameGroups;
     QList<QContact> m_contactsToCreate;
     QList<ContactIdType> m_contactsToRemove;
-    QList<ContactIdType> m_changedContacts;
+    QList<ProcessingBatch> m_processingBatches;
+    QSet<ContactIdType> m_changedContacts;
     QList<QContactId> m_contactsToFetchConstituents;
     QList<SeasideNameGroupChangeListener*> m_nameGroupChangeListeners;
     QVector<ContactIdType> m_contacts[SeasideFilteredModel::FilterTypesCount];
     QList<SeasideFilteredModel *> m_models[SeasideFilteredModel::FilterTypesCount];
+    QHash<quint32, int> m_contactRows[SeasideFilteredModel::FilterTypesCount];
+    SynchronizeListState<ContactIdType> m_queryState;
     QSet<QObject *> m_users;
     QHash<ContactIdType,int> m_expiredContacts;
     QContactManager m_manager;
     QContactFetchRequest m_fetchRequest;
+    QContactFetchRequest m_completionRequest;
+    PopulationStage m_populationStages[SeasideFilteredModel::FilterTypesCount];
     QContactFetchByIdRequest m_fetchByIdRequest;
 #ifdef USING_QTPIM
     QContactIdFetchRequest m_contactIdRequest;
+    QContactIdFetchRequest m_removedIdRequest;
 #else
     QContactLocalIdFetchRequest m_contactIdRequest;
+    QContactLocalIdFetchRequest m_removedIdRequest;
 #endif
     QContactRelationshipFetchRequest m_relationshipsFetchRequest;
     QContactRemoveRequest m_removeRequest;
@@ -208,21 +390,32 @@ private:
 #ifdef HAS_MLITE
     MGConfItem m_displayLabelOrderConf;
 #endif
-    int m_resultsRead;
+    RequestLane m_requestLanes[RequestTypesCount];
+    int m_maxActiveRequests;
+    int m_postponementInterval;
     int m_populated;
     int m_cacheIndex;
     int m_queryIndex;
-    int m_appendIndex;
+    int m_populationBudget;
+    int m_pageSize;
+    int m_completeContactBudget;
+    int m_completeContactBytes;
     SeasideFilteredModel::FilterType m_fetchFilter;
+    FetchProfile m_fetchProfile;
     SeasideFilteredModel::DisplayLabelOrder m_displayLabelOrder;
     bool m_updatesPending;
     bool m_fetchActive;
     bool m_refreshRequired;
     bool m_contactsUpdated;
+    bool m_fetchingDelta;
+    bool m_processInBackground;
     QList<ContactIdType> m_constituentIds;
+    QDateTime m_syncWatermark;
+    QDateTime m_deltaSince;
 
     QElapsedTimer m_timer;
     QElapsedTimer m_fetchPostponed;
+    QElapsedTimer m_changeReported;
 
     static SeasideCache *instance;
     static QList<QChar> allContactNameGroups;
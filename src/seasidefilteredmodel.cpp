@@ -35,7 +35,6 @@
 #include "synchronizelists_p.h"
 #include "constants_p.h"
 
-#include <QContactAvatar>
 #include <QContactEmailAddress>
 #include <QContactName>
 #include <QContactNickname>
@@ -48,13 +47,28 @@
 
 #include <QtDebug>
 
-// We could squeeze a little more performance out of QVector by inserting all the items in a
-// single hit, but tests are more important right now.
+#include <algorithm>
+
+// Inserts count items of source in a single hit, so the tail of the destination is moved once
+// rather than for every item.
 static void insert(
-        QVector<SeasideFilteredModel::ContactIdType> *destination, int to, const QVector<SeasideFilteredModel::ContactIdType> &source)
+        QVector<SeasideFilteredModel::ContactIdType> *destination,
+        int to,
+        const QVector<SeasideFilteredModel::ContactIdType> &source,
+        int from,
+        int count)
 {
-    for (int i = 0; i < source.count(); ++i)
-        destination->insert(to + i, source.at(i));
+    destination->insert(to, count, SeasideFilteredModel::ContactIdType());
+    std::copy(source.constBegin() + from, source.constBegin() + from + count, destination->begin() + to);
+}
+
+// Moves count items from index to before the item at destination, as QAbstractItemModel
+// counts them.
+static void move(QVector<SeasideFilteredModel::ContactIdType> *list, int index, int count, int destination)
+{
+    const QVector<SeasideFilteredModel::ContactIdType> items = list->mid(index, count);
+    list->remove(index, count);
+    insert(list, destination > index ? destination - count : destination, items, 0, count);
 }
 
 // Splits a string at word boundaries identified by QTextBoundaryFinder and returns a list of
@@ -331,60 +345,61 @@ void insert(QSet<T> &set, const QList<T> &list)
         set.insert(item);
 }
 
-bool SeasideFilteredModel::filterId(const ContactIdType &contactId) const
+QStringList SeasideFilteredModel::filterKey(const QContact &contact)
 {
-    if (m_filterParts.isEmpty())
-        return true;
-
-    SeasideCacheItem *item = SeasideCache::cacheItemById(contactId);
-    if (!item)
-        return false;
-
-    if (m_searchByFirstNameCharacter && !m_filterPattern.isEmpty())
-        return m_filterPattern[0].toUpper() == SeasideCache::nameGroupForCacheItem(item);
-
     // split the display label and filter into words.
     //
     // TODO: i18n will require different splitting for thai and possibly
     // other locales, see MBreakIterator
 
-    if (item->filterKey.isEmpty()) {
-        QSet<QString> matchTokens;
+    QSet<QString> matchTokens;
 
-        QContactName name = item->contact.detail<QContactName>();
-        insert(matchTokens, splitWords(name.firstName()));
-        insert(matchTokens, splitWords(name.middleName()));
-        insert(matchTokens, splitWords(name.lastName()));
-        insert(matchTokens, splitWords(name.prefix()));
-        insert(matchTokens, splitWords(name.suffix()));
+    QContactName name = contact.detail<QContactName>();
+    insert(matchTokens, splitWords(name.firstName()));
+    insert(matchTokens, splitWords(name.middleName()));
+    insert(matchTokens, splitWords(name.lastName()));
+    insert(matchTokens, splitWords(name.prefix()));
+    insert(matchTokens, splitWords(name.suffix()));
 
-        QContactNickname nickname = item->contact.detail<QContactNickname>();
-        insert(matchTokens, splitWords(nickname.nickname()));
+    QContactNickname nickname = contact.detail<QContactNickname>();
+    insert(matchTokens, splitWords(nickname.nickname()));
 
-        // Include the custom label - it may contain the user's customized name for the contact
+    // Include the custom label - it may contain the user's customized name for the contact
 #ifdef USING_QTPIM
-        insert(matchTokens, splitWords(item->contact.detail<QContactName>().value<QString>(QContactName__FieldCustomLabel)));
+    insert(matchTokens, splitWords(name.value<QString>(QContactName__FieldCustomLabel)));
 #else
-        insert(matchTokens, splitWords(item->contact.detail<QContactName>().customLabel()));
+    insert(matchTokens, splitWords(name.customLabel()));
 #endif
 
-        foreach (const QContactPhoneNumber &detail, item->contact.details<QContactPhoneNumber>())
-            insert(matchTokens, splitWords(detail.number()));
-        foreach (const QContactEmailAddress &detail, item->contact.details<QContactEmailAddress>())
-            insert(matchTokens, splitWords(detail.emailAddress()));
-        foreach (const QContactOrganization &detail, item->contact.details<QContactOrganization>())
-            insert(matchTokens, splitWords(detail.name()));
-        foreach (const QContactOnlineAccount &detail, item->contact.details<QContactOnlineAccount>()) {
-            insert(matchTokens, splitWords(detail.accountUri()));
-            insert(matchTokens, splitWords(detail.serviceProvider()));
-        }
-        foreach (const QContactGlobalPresence &detail, item->contact.details<QContactGlobalPresence>())
-            insert(matchTokens, splitWords(detail.nickname()));
-        foreach (const QContactPresence &detail, item->contact.details<QContactPresence>())
-            insert(matchTokens, splitWords(detail.nickname()));
-
-        item->filterKey = matchTokens.toList();
+    foreach (const QContactPhoneNumber &detail, contact.details<QContactPhoneNumber>())
+        insert(matchTokens, splitWords(detail.number()));
+    foreach (const QContactEmailAddress &detail, contact.details<QContactEmailAddress>())
+        insert(matchTokens, splitWords(detail.emailAddress()));
+    foreach (const QContactOrganization &detail, contact.details<QContactOrganization>())
+        insert(matchTokens, splitWords(detail.name()));
+    foreach (const QContactOnlineAccount &detail, contact.details<QContactOnlineAccount>()) {
+        insert(matchTokens, splitWords(detail.accountUri()));
+        insert(matchTokens, splitWords(detail.serviceProvider()));
     }
+    foreach (const QContactGlobalPresence &detail, contact.details<QContactGlobalPresence>())
+        insert(matchTokens, splitWords(detail.nickname()));
+    foreach (const QContactPresence &detail, contact.details<QContactPresence>())
+        insert(matchTokens, splitWords(detail.nickname()));
+
+    return matchTokens.toList();
+}
+
+bool SeasideFilteredModel::filterId(const ContactIdType &contactId) const
+{
+    if (m_filterParts.isEmpty())
+        return true;
+
+    SeasideCacheItem *item = SeasideCache::cacheItemById(contactId);
+    if (!item)
+        return false;
+
+    if (m_searchByFirstNameCharacter && !m_filterPattern.isEmpty())
+        return m_filterPattern[0].toUpper() == SeasideCache::nameGroupForCacheItem(item);
 
     // search forwards over the label components for each filter word, making
     // sure to find all filter words before considering it a match.
@@ -412,20 +427,32 @@ bool SeasideFilteredModel::filterId(const ContactIdType &contactId) const
     return true;
 }
 
-void SeasideFilteredModel::insertRange(
+int SeasideFilteredModel::insertRange(
         int index, int count, const QVector<ContactIdType> &source, int sourceIndex)
 {
     beginInsertRows(QModelIndex(), index, index + count - 1);
-    for (int i = 0; i < count; ++i)
-        m_filteredContactIds.insert(index + i, source.at(sourceIndex + i));
+    insert(&m_filteredContactIds, index, source, sourceIndex, count);
     endInsertRows();
+
+    return count;
 }
 
-void SeasideFilteredModel::removeRange(int index, int count)
+int SeasideFilteredModel::moveRange(int index, int count, int destination)
+{
+    beginMoveRows(QModelIndex(), index, index + count - 1, QModelIndex(), destination);
+    move(&m_filteredContactIds, index, count, destination);
+    endMoveRows();
+
+    return destination < index ? count : 0;
+}
+
+int SeasideFilteredModel::removeRange(int index, int count)
 {
     beginRemoveRows(QModelIndex(), index, index + count - 1);
     m_filteredContactIds.remove(index, count);
     endRemoveRows();
+
+    return 0;
 }
 
 void SeasideFilteredModel::refineIndex()
@@ -451,18 +478,27 @@ void SeasideFilteredModel::refineIndex()
 
 void SeasideFilteredModel::updateIndex()
 {
+    // Where the cache can find the matching contacts, the filtered list is synchronized with
+    // those alone rather than with every contact of the reference list.
+    QVector<ContactIdType> matchingIds;
+    const bool matched = matchIndex(&matchingIds);
+    const QVector<ContactIdType> &referenceIds = matched ? matchingIds : *m_referenceContactIds;
+
     int f = 0;
     int r = 0;
-    synchronizeFilteredList(this, m_filteredContactIds, f, *m_referenceContactIds, r);
+    if (matched)
+        synchronizeList(this, m_filteredContactIds, f, referenceIds, r);
+    else
+        synchronizeFilteredList(this, m_filteredContactIds, f, referenceIds, r);
 
     if (f < m_filteredContactIds.count())
         removeRange(f, m_filteredContactIds.count() - f);
 
-    if (r < m_referenceContactIds->count()) {
+    if (r < referenceIds.count()) {
         QVector<ContactIdType> insertIds;
-        for (; r < m_referenceContactIds->count(); ++r) {
-            if (filterId(m_referenceContactIds->at(r)))
-                insertIds.append(m_referenceContactIds->at(r));
+        for (; r < referenceIds.count(); ++r) {
+            if (matched || filterId(referenceIds.at(r)))
+                insertIds.append(referenceIds.at(r));
         }
         if (insertIds.count() > 0) {
             beginInsertRows(
@@ -475,13 +511,40 @@ void SeasideFilteredModel::updateIndex()
     }
 }
 
+bool SeasideFilteredModel::matchIndex(QVector<ContactIdType> *contactIds) const
+{
+    // Matching on the name group, or a list which isn't one of the cache's own, requires
+    // every contact to be tested.
+    if (m_filterParts.isEmpty() || m_searchByFirstNameCharacter)
+        return false;
+
+    const FilterType filterType = m_filterType == FilterNone ? FilterAll : m_filterType;
+    if (m_referenceContactIds != SeasideCache::contacts(filterType)
+            || !SeasideCache::matchContacts(filterType, m_filterParts, contactIds)) {
+        return false;
+    }
+
+    // The cache finds the contacts with a token starting with each of the words, in any
+    // order; the filter decides which of those match.
+    int count = 0;
+    for (int i = 0; i < contactIds->count(); ++i) {
+        if (filterId(contactIds->at(i)))
+            (*contactIds)[count++] = contactIds->at(i);
+    }
+    contactIds->resize(count);
+
+    return true;
+}
+
 void SeasideFilteredModel::populateIndex()
 {
-    // The filtered list is empty, so just scan through the reference list and append any
-    // items that match the filter.
-    for (int i = 0; i < m_referenceContactIds->count(); ++i) {
-        if (filterId(m_referenceContactIds->at(i)))
-            m_filteredContactIds.append(m_referenceContactIds->at(i));
+    // The filtered list is empty, so just take the matching items from the cache or, failing
+    // that, scan through the reference list and append any items that match the filter.
+    if (!matchIndex(&m_filteredContactIds)) {
+        for (int i = 0; i < m_referenceContactIds->count(); ++i) {
+            if (filterId(m_referenceContactIds->at(i)))
+                m_filteredContactIds.append(m_referenceContactIds->at(i));
+        }
     }
     if (!m_filteredContactIds.isEmpty())
         beginInsertRows(QModelIndex(), 0, m_filteredContactIds.count() - 1);
@@ -497,16 +560,12 @@ void SeasideFilteredModel::populateIndex()
 QVariantMap SeasideFilteredModel::get(int row) const
 {
     // needed for SectionScroller.
-    SeasideCacheItem *cacheItem = SeasideCache::cacheItemById(m_contactIds->at(row));
+    SeasideCacheItem *cacheItem = SeasideCache::displayedItemById(m_contactIds->at(row));
     QString sectionBucket;
     if (cacheItem && cacheItem->person) {
         sectionBucket = cacheItem->person->sectionBucket();
     } else if (cacheItem) {
-#ifdef USING_QTPIM
-        QString displayLabel = cacheItem->contact.detail<QContactName>().value<QString>(QContactName__FieldCustomLabel);
-#else
-        QString displayLabel = cacheItem->contact.detail<QContactName>().customLabel();
-#endif
+        const QString &displayLabel = cacheItem->displayLabel;
         if (!displayLabel.isEmpty())
             sectionBucket = displayLabel.at(0).toUpper();
     }
@@ -564,28 +623,22 @@ QVariant SeasideFilteredModel::data(const QModelIndex &index, int role) const
     if (!index.isValid())
         return QVariant();
 
-    SeasideCacheItem *cacheItem = SeasideCache::cacheItemById(m_contactIds->at(index.row()));
+    SeasideCacheItem *cacheItem = SeasideCache::displayedItemById(m_contactIds->at(index.row()));
     if (!cacheItem)
         return QVariant();
 
     // Avoid creating a Person instance for as long as possible.
     if (role == FirstNameRole || role == LastNameRole) {
-        QContactName name = cacheItem->contact.detail<QContactName>();
-
         return role == FirstNameRole
-                ? name.firstName()
-                : name.lastName();
+                ? cacheItem->firstName
+                : cacheItem->lastName;
     } else if (role == AvatarRole) {
-        QUrl avatarUrl = cacheItem->contact.detail<QContactAvatar>().imageUrl();
+        const QUrl &avatarUrl = cacheItem->avatarUrl;
         return avatarUrl.isEmpty()
                 ? QUrl(QLatin1String("image://theme/icon-m-telephony-contact-avatar"))
                 : avatarUrl;
     } else if (role != PersonRole && !cacheItem->person) {  // Display or Section Bucket.
-#ifdef USING_QTPIM
-        QString displayLabel = cacheItem->contact.detail<QContactName>().value<QString>(QContactName__FieldCustomLabel);
-#else
-        QString displayLabel = cacheItem->contact.detail<QContactName>().customLabel();
-#endif
+        const QString &displayLabel = cacheItem->displayLabel;
 
         return role == Qt::DisplayRole || displayLabel.isEmpty()
                 ? displayLabel
@@ -690,13 +743,72 @@ void SeasideFilteredModel::sourceItemsInserted(int begin, int end)
             m_filterIndex = f + insertIds.count();
 
             beginInsertRows(QModelIndex(), f, f + insertIds.count() - 1);
-            insert(&m_filteredContactIds, f, insertIds);
+            insert(&m_filteredContactIds, f, insertIds, 0, insertIds.count());
             endInsertRows();
             emit countChanged();
         }
     }
 }
 
+void SeasideFilteredModel::sourceAboutToMoveItems(int begin, int end, int destination)
+{
+    if (m_filterPattern.isEmpty())
+        beginMoveRows(QModelIndex(), begin, end, QModelIndex(), destination);
+}
+
+void SeasideFilteredModel::sourceItemsMoved(int begin, int end, int destination)
+{
+    if (m_filterPattern.isEmpty()) {
+        endMoveRows();
+        return;
+    }
+
+    // The moved items are no longer where the progressive indexes expect them.
+    m_referenceIndex = 0;
+    m_filterIndex = 0;
+
+    const int count = end - begin + 1;
+    const int to = destination > begin ? destination - count : destination;
+
+    // The moved items were consecutive in the reference list, so those which match the filter
+    // are consecutive in the filtered list too.
+    QSet<ContactIdType> movedIds;
+    for (int r = to; r < to + count; ++r)
+        movedIds.insert(m_referenceContactIds->at(r));
+
+    int from = 0;
+    while (from < m_filteredContactIds.count() && !movedIds.contains(m_filteredContactIds.at(from)))
+        ++from;
+    int movedCount = 0;
+    while (from + movedCount < m_filteredContactIds.count()
+            && movedIds.contains(m_filteredContactIds.at(from + movedCount))) {
+        ++movedCount;
+    }
+    if (movedCount == 0)
+        return;
+
+    // Count the other filtered items now preceding the moved ones in the reference list, in a
+    // single pass as the two lists are otherwise in the same order.
+    int preceding = 0;
+    for (int f = 0, r = 0; f < m_filteredContactIds.count(); ++f) {
+        if (f == from) {
+            f += movedCount - 1;
+            continue;
+        }
+        r = m_referenceContactIds->indexOf(m_filteredContactIds.at(f), r);
+        if (r < 0 || r >= to)
+            break;
+        ++preceding;
+    }
+
+    if (preceding != from) {
+        const int f = preceding > from ? preceding + movedCount : preceding;
+        beginMoveRows(QModelIndex(), from, from + movedCount - 1, QModelIndex(), f);
+        move(&m_filteredContactIds, from, movedCount, f);
+        endMoveRows();
+    }
+}
+
 void SeasideFilteredModel::sourceDataChanged(int begin, int end)
 {
     if (m_filterPattern.isEmpty()) {
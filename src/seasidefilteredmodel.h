@@ -92,6 +92,8 @@ public:
     static quint32 internalId(QContactLocalId id);
 #endif
 
+    static QStringList filterKey(const QContact &contact);
+
     SeasideFilteredModel(QObject *parent = 0);
     ~SeasideFilteredModel();
 
@@ -136,6 +138,9 @@ public:
     void sourceAboutToInsertItems(int begin, int end);
     void sourceItemsInserted(int begin, int end);
 
+    void sourceAboutToMoveItems(int begin, int end, int destination);
+    void sourceItemsMoved(int begin, int end, int destination);
+
     void sourceDataChanged(int begin, int end);
 
     void makePopulated();
@@ -145,8 +150,9 @@ public:
 
     // For synchronizeLists()
     bool filterValue(const ContactIdType &contactId) const { return filterId(contactId); }
-    void insertRange(int index, int count, const QVector<ContactIdType> &source, int sourceIndex);
-    void removeRange(int index, int count);
+    int insertRange(int index, int count, const QVector<ContactIdType> &source, int sourceIndex);
+    int removeRange(int index, int count);
+    int moveRange(int index, int count, int destination);
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
     virtual
@@ -165,6 +171,7 @@ private:
     void populateIndex();
     void refineIndex();
     void updateIndex();
+    bool matchIndex(QVector<ContactIdType> *contactIds) const;
     void updateContactData(const ContactIdType &contactId, SeasideFilteredModel::FilterType filter);
 
     QVector<ContactIdType> m_filteredContactIds;
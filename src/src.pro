@@ -7,7 +7,7 @@ TEMPLATE = lib
 CONFIG += qt plugin hide_symbols
 
 equals(QT_MAJOR_VERSION, 4): QT += declarative
-equals(QT_MAJOR_VERSION, 5): QT += qml
+equals(QT_MAJOR_VERSION, 5): QT += qml concurrent
 
 equals(QT_MAJOR_VERSION, 4): target.path = $$[QT_INSTALL_IMPORTS]/$$PLUGIN_IMPORT_PATH
 equals(QT_MAJOR_VERSION, 5): target.path = $$[QT_INSTALL_QML]/$$PLUGIN_IMPORT_PATH
@@ -37,18 +37,27 @@ equals(QT_MAJOR_VERSION, 5) {
 }
 
 SOURCES += $$PWD/plugin.cpp \
+           $$PWD/contactrecord_p.cpp \
            $$PWD/normalization_p.cpp \
+           $$PWD/prefixindex_p.cpp \
            $$PWD/seasideperson.cpp \
            $$PWD/seasidecache.cpp \
+           $$PWD/seasidecachediagnostics.cpp \
            $$PWD/seasidefilteredmodel.cpp \
-           $$PWD/seasidenamegroupmodel.cpp
+           $$PWD/seasidenamegroupmodel.cpp \
+           $$PWD/stringpool_p.cpp
 
 HEADERS += \
+           $$PWD/cacheitemtable_p.h \
            $$PWD/constants_p.h \
+           $$PWD/contactrecord_p.h \
            $$PWD/normalization_p.h \
+           $$PWD/prefixindex_p.h \
+           $$PWD/stringpool_p.h \
            $$PWD/synchronizelists_p.h \
            $$PWD/seasideperson.h \
            $$PWD/seasidecache.h \
+           $$PWD/seasidecachediagnostics.h \
            $$PWD/seasidefilteredmodel.h \
            $$PWD/seasidenamegroupmodel.h
 
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include "stringpool_p.h"
+
+static qint64 stringBytes(const QString &string)
+{
+    return qint64(string.size()) * sizeof(QChar);
+}
+
+// Returns the number of strings sharing the data of a string, including itself.
+static int references(const QString &string)
+{
+    QString::DataPtr data = const_cast<QString &>(string).data_ptr();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    return data->ref.atomic.load();
+#else
+    return data->ref;
+#endif
+}
+
+StringPool::StringPool()
+    : m_size(0)
+{
+}
+
+QString StringPool::intern(const QString &string)
+{
+    // Empty strings share static data already.
+    if (string.isEmpty())
+        return string;
+
+    QSet<QString>::const_iterator it = m_strings.constFind(string);
+    if (it == m_strings.constEnd()) {
+        m_strings.insert(string);
+        m_size += stringBytes(string);
+        return string;
+    }
+
+    return *it;
+}
+
+void StringPool::intern(QStringList *strings)
+{
+    for (QStringList::iterator it = strings->begin(); it != strings->end(); ++it)
+        *it = intern(*it);
+}
+
+void StringPool::purge()
+{
+    for (QSet<QString>::iterator it = m_strings.begin(); it != m_strings.end();) {
+        // The only reference to a detached string is the one held by the pool.
+        if (it->isDetached()) {
+            m_size -= stringBytes(*it);
+            it = m_strings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int StringPool::count() const
+{
+    return m_strings.count();
+}
+
+qint64 StringPool::size() const
+{
+    return m_size;
+}
+
+qint64 StringPool::bytesSaved() const
+{
+    // Each string held beyond the first, other than by the pool, would otherwise be a copy.
+    // Static data is not counted.
+    qint64 bytes = 0;
+    for (QSet<QString>::const_iterator it = m_strings.constBegin(); it != m_strings.constEnd(); ++it)
+        bytes += qMax(0, references(*it) - 2) * stringBytes(*it);
+    return bytes;
+}
@@ -32,9 +32,12 @@
 #ifndef SYNCHRONIZELISTS_P_H
 #define SYNCHRONIZELISTS_P_H
 
+#include <QHash>
 #include <QVector>
 #include <QtDebug>
 
+#include <limits.h>
+
 // Helper utility to synchronize a cached list with some reference list with correct
 // QAbstractItemModel signals and filtering.
 
@@ -44,110 +47,331 @@
 // the remaining items can be synchronized manually by removing the remaining items from the
 // cache list before (filtering and) appending the remaining reference items.
 
+// Items found in both lists but in a different order are moved rather than removed and inserted
+// again, as long as no more than MaximumMoves are needed; beyond that, as when the whole list is
+// reordered, removing and inserting ranges is cheaper.  The agent's insertRange(), removeRange()
+// and moveRange() each return the amount the index c must advance to reach the next item of
+// the cache yet to be synchronized.
+
+// When the reference list is delivered over many calls a SynchronizeListState can be passed to
+// each, so the items of either list are indexed once rather than on every call and the cost of
+// a call is proportional to the reference items delivered since the last.  The cache list must
+// only be modified by the agent until the synchronization is complete and the state cleared.
+
+template <typename ValueType>
+struct SynchronizeListState
+{
+    SynchronizeListState() { clear(); }
+
+    void clear()
+    {
+        referencePositions.clear();
+        cachePositions.clear();
+        referenceIndexed = 0;
+        cacheCount = -1;
+        cacheIndexed = false;
+        o = 0;
+        moves = 0;
+        searchC = -1;
+        searchR = -1;
+        searched = 0;
+    }
+
+    QHash<ValueType, int> referencePositions;
+    QHash<ValueType, int> cachePositions;
+    int referenceIndexed;
+    int cacheCount;
+    bool cacheIndexed;
+    int o;
+    int moves;
+    int searchC;
+    int searchR;
+    int searched;
+};
+
 template <typename Agent, typename ValueType, typename ReferenceList>
 class SynchronizeList
 {
 public:
+    enum { MaximumMoves = 16 };
+
     SynchronizeList(
             Agent *agent,
             const QVector<ValueType> &cache,
             int &c,
             const ReferenceList &reference,
-            int &r)
+            int &r,
+            SynchronizeListState<ValueType> &state)
         : agent(agent), cache(cache), c(c), reference(reference), r(r)
+        , referencePositions(state.referencePositions), cachePositions(state.cachePositions)
+        , referenceIndexed(state.referenceIndexed), cacheIndexed(state.cacheIndexed)
+        , o(state.o), moves(state.moves)
+        , searchC(state.searchC), searchR(state.searchR), searched(state.searched)
+    {
+        // The positions indexed in an earlier call are no longer valid if the cache has been
+        // modified since, nor is the extent of a search made from them.
+        if (state.cacheCount != cache.count()) {
+            cacheIndexed = false;
+            searchC = -1;
+        }
+
+        synchronize();
+
+        state.cacheCount = cache.count();
+    }
+
+private:
+    void synchronize()
     {
         while (c < cache.count() && r < reference.count()) {
             if (cache.at(c) == reference.at(r)) {
                 ++c;
                 ++r;
+                ++o;
                 continue;
             }
 
-            bool match = false;
+            // Find the first point of commonality, with the fewest items traversed in either
+            // list, and resolve the differences preceding it.  The positions of the remaining
+            // items of each list are indexed, so each item traversed is looked up only once.
+            // Every point is found by looking up the items of the reference list, so the
+            // search ends with those delivered so far.
+            index();
 
-            // Iterate through both the reference and cache lists in parallel looking for first
-            // point of commonality, when that is found resolve the differences and continue
-            // looking.
-            int count = 1;
-            for (; !match && c + count < cache.count() && r + count < reference.count(); ++count) {
-                const ValueType cacheValue = cache.at(c + count);
-                const ValueType referenceValue = reference.at(r + count);
+            int cacheCount = -1;
+            int referenceCount = -1;
+            int traversed = INT_MAX;
 
-                for (int i = 0; i <= count; ++i) {
-                    if (cacheMatch(i, count, referenceValue) || referenceMatch(i, count, cacheValue)) {
-                        match = true;
-                        break;
+            // A search from the same items which ended without a point in an earlier call
+            // continues from where it ended.  The cache items it passed may be found among
+            // the reference items delivered since, further on than those it passed.
+            const int resumed = c == searchC && r == searchR ? searched : 0;
+
+            int i = resumed;
+            for (; i < traversed && r + i < reference.count(); ++i) {
+                if (c + i < cache.count()) {
+                    const int j = referencePosition(cache.at(c + i));
+                    if (j >= 0 && isCloser(i, j, cacheCount, referenceCount)) {
+                        cacheCount = i;
+                        referenceCount = j;
                     }
                 }
-            }
-
-            // Continue scanning the reference list if the cache has been exhausted.
-            for (int re = r + count; !match && re < reference.count(); ++re) {
-                const ValueType referenceValue = reference.at(re);
-                for (int i = 0; i < count; ++i) {
-                    if (cacheMatch(i, re - r, referenceValue)) {
-                        match = true;
-                        break;
+                if (r + i < reference.count()) {
+                    const int j = cachePosition(reference.at(r + i));
+                    if (j >= 0 && isCloser(j, i, cacheCount, referenceCount)) {
+                        cacheCount = j;
+                        referenceCount = i;
                     }
                 }
+                if (cacheCount >= 0)
+                    traversed = qMax(cacheCount, referenceCount);
             }
 
-            // Continue scanning the cache if the reference list has been exhausted.
-            for (int ce = c + count; !match && ce < cache.count(); ++ce) {
-                const ValueType cacheValue = cache.at(ce);
-                for (int i = 0; i < count; ++i) {
-                    if (referenceMatch(i, ce - c, cacheValue)) {
-                        match = true;
-                        break;
-                    }
+            // Any such point found by looking up the reference items traversed is found again
+            // that way, but one at the distance the search ended is not.
+            if (resumed > 0 && cacheCount >= 0 && r + traversed < reference.count()) {
+                const int j = cachePosition(reference.at(r + traversed));
+                if (j >= 0 && j < resumed && isCloser(j, traversed, cacheCount, referenceCount)) {
+                    cacheCount = j;
+                    referenceCount = traversed;
                 }
             }
 
-            if (!match)
+            if (cacheCount < 0) {
+                searchC = c;
+                searchR = r;
+                searched = i;
                 return;
+            }
+
+            removeItems(cacheCount, referenceCount);
+            insertItems(referenceCount);
+
+            c += 1;
+            r += referenceCount + 1;
+            o += 1;
         }
     }
 
-private:
-    // Tests if the cached value at i matches a referenceValue.
-    // If there is a match removes all items traversed in the cache since the previous match
-    // and inserts any items in the reference set found to to not be in the cache.
-    bool cacheMatch(int i, int count, ValueType referenceValue)
+    // Removes count items of the cache from c, other than those found further on in the
+    // reference list, which are moved ahead to precede the item following them there.
+    void removeItems(int count, int referenceCount)
     {
-        if (cache.at(c + i) == referenceValue) {
-            if (i > 0)
-                c += agent->removeRange(c, i);
-            c += agent->insertRange(c, count, reference, r) + 1;
-            r += count + 1;
-            return true;
-        } else {
-            return false;
+        while (count > 0) {
+            int removeCount = 0;
+            int moveCount = 0;
+            int destination = -1;
+            for (; removeCount < count; ++removeCount) {
+                destination = moveDestination(removeCount, count, referenceCount, &moveCount);
+                if (destination >= 0)
+                    break;
+            }
+
+            if (removeCount > 0) {
+                c += agent->removeRange(c, removeCount);
+                o += removeCount;
+                count -= removeCount;
+            }
+
+            if (destination >= 0) {
+                // The removal preceding the items may have changed their distance from c.
+                destination = moveDestination(0, count, referenceCount, &moveCount);
+                c += agent->moveRange(c, moveCount, c + destination);
+                cacheIndexed = false;
+                ++moves;
+                count -= moveCount;
+            }
         }
     }
 
-    // Tests if the reference value at i matches a cacheValue.
-    // If there is a match inserts all items traversed in the reference set since the
-    // previous match and removes any items from the cache that were not found in the
-    // reference list.
-    bool referenceMatch(int i, int count, ValueType cacheValue)
+    // Inserts count items of the reference list from r at c, other than those found further on
+    // in the cache, which are moved back from there instead.
+    void insertItems(int count)
     {
-        if (reference.at(r + i) == cacheValue) {
-            c += agent->removeRange(c, count);
-            if (i > 0)
-                c += agent->insertRange(c, i, reference, r);
-            c += 1;
-            r += i + 1;
-            return true;
-        } else {
-            return false;
+        for (int i = 0; i < count;) {
+            int insertCount = 0;
+            int source = -1;
+            for (; i + insertCount < count; ++insertCount) {
+                source = moveSource(reference.at(r + i + insertCount), count);
+                if (source >= 0)
+                    break;
+            }
+
+            if (insertCount > 0) {
+                c += agent->insertRange(c, insertCount, reference, r + i);
+                i += insertCount;
+            }
+
+            if (source >= 0) {
+                // The items following in the reference list which also follow in the cache
+                // are moved along with it.
+                int moveCount = 1;
+                while (i + moveCount < count
+                        && cachePosition(reference.at(r + i + moveCount)) == source + moveCount) {
+                    ++moveCount;
+                }
+
+                c += agent->moveRange(c + source, moveCount, c);
+                cacheIndexed = false;
+                ++moves;
+                i += moveCount;
+            }
+        }
+    }
+
+    // Returns the distance from c the cache items from c + index should be moved to, or -1 if
+    // the item there should be removed.  The count items from c precede the next item in
+    // common; items are only moved out of a short run.  The items following which also follow
+    // in the reference list are moved along, moveCount is set to the number moved.
+    int moveDestination(int index, int count, int referenceCount, int *moveCount)
+    {
+        if (moves >= MaximumMoves || count > MaximumMoves)
+            return -1;
+
+        const int position = referencePosition(cache.at(c + index));
+        if (position <= referenceCount)
+            return -1;
+
+        *moveCount = 1;
+        while (index + *moveCount < count
+                && referencePosition(cache.at(c + index + *moveCount)) == position + *moveCount) {
+            ++*moveCount;
+        }
+
+        // Move the items before the first item following them in the reference list that is
+        // also in the cache, or to the end of the cache if there is none.
+        int destination = cache.count() - c;
+        for (int i = r + position + *moveCount; i < reference.count(); ++i) {
+            const int next = cachePosition(reference.at(i));
+            if (next >= 0) {
+                destination = next;
+                break;
+            }
+        }
+        return destination > count ? destination : -1;
+    }
+
+    // Returns the distance from c of a cache item the reference value at c can be moved from,
+    // or -1 if it should be inserted.  Only some of the count items being inserted may be
+    // moved.
+    int moveSource(const ValueType &value, int count)
+    {
+        if (moves >= MaximumMoves || count > MaximumMoves)
+            return -1;
+
+        const int source = cachePosition(value);
+        return source > 0 ? source : -1;
+    }
+
+    // Records the positions of the items from c and r onwards.  The positions in the cache
+    // are relative to c when recorded, o counts the cache items since passed.  Moving items
+    // changes the positions of those between, so the cache is indexed again after a move.
+    void index()
+    {
+        if (referenceIndexed < reference.count()) {
+            for (int i = qMax(r, referenceIndexed); i < reference.count(); ++i) {
+                typename QHash<ValueType, int>::iterator it = referencePositions.find(reference.at(i));
+                if (it == referencePositions.end())
+                    referencePositions.insert(reference.at(i), i);
+                else if (*it < r)
+                    *it = i;
+            }
+            referenceIndexed = reference.count();
+        }
+        if (!cacheIndexed) {
+            cachePositions.clear();
+            for (int i = c; i < cache.count(); ++i) {
+                if (!cachePositions.contains(cache.at(i)))
+                    cachePositions.insert(cache.at(i), i - c);
+            }
+            cacheIndexed = true;
+            o = 0;
         }
     }
 
+    // Returns the number of reference items preceding a cache value, or -1 if the value
+    // does not follow in the reference list.
+    int referencePosition(const ValueType &value)
+    {
+        index();
+        typename QHash<ValueType, int>::const_iterator it = referencePositions.find(value);
+        return it != referencePositions.end() && *it >= r ? *it - r : -1;
+    }
+
+    // Returns the number of cache items preceding a reference value, or -1 if the value
+    // does not follow in the cache.
+    int cachePosition(const ValueType &value)
+    {
+        index();
+        typename QHash<ValueType, int>::const_iterator it = cachePositions.find(value);
+        return it != cachePositions.end() && *it >= o ? *it - o : -1;
+    }
+
+    // Prefers the point traversing the fewest items in either list, and then in both.
+    static bool isCloser(int cacheCount, int referenceCount, int bestCacheCount, int bestReferenceCount)
+    {
+        if (bestCacheCount < 0)
+            return true;
+        const int traversed = qMax(cacheCount, referenceCount);
+        const int bestTraversed = qMax(bestCacheCount, bestReferenceCount);
+        return traversed < bestTraversed || (traversed == bestTraversed
+                && cacheCount + referenceCount < bestCacheCount + bestReferenceCount);
+    }
+
     Agent * const agent;
     const QVector<ValueType> &cache;
     int &c;
     const ReferenceList &reference;
     int &r;
+    QHash<ValueType, int> &referencePositions;
+    QHash<ValueType, int> &cachePositions;
+    int &referenceIndexed;
+    bool &cacheIndexed;
+    int &o;
+    int &moves;
+    int &searchC;
+    int &searchR;
+    int &searched;
 };
 
 template <typename Agent, typename ValueType, typename ReferenceList>
@@ -158,7 +382,20 @@ void synchronizeList(
         const ReferenceList &reference,
         int &r)
 {
-    SynchronizeList<Agent, ValueType, ReferenceList>(agent, cache, c, reference, r);
+    SynchronizeListState<ValueType> state;
+    SynchronizeList<Agent, ValueType, ReferenceList>(agent, cache, c, reference, r, state);
+}
+
+template <typename Agent, typename ValueType, typename ReferenceList>
+void synchronizeList(
+        Agent *agent,
+        const QVector<ValueType> &cache,
+        int &c,
+        const ReferenceList &reference,
+        int &r,
+        SynchronizeListState<ValueType> &state)
+{
+    SynchronizeList<Agent, ValueType, ReferenceList>(agent, cache, c, reference, r, state);
 }
 
 template <typename Agent, typename ValueType, typename ReferenceList>
@@ -239,6 +476,40 @@ public:
         return adjustedIndex - index;
     }
 
+    int moveRange(int index, int count, int destination)
+    {
+        // Apply any changes pending before the items, so they are moved between their
+        // actual positions.
+        int adjustment = 0;
+        if (filteredValues.count() > 0) {
+            agent->insertRange(previousIndex, filteredValues.count(), filteredValues, 0);
+            adjustment += filteredValues.count();
+            previousIndex += filteredValues.count();
+            filteredValues.resize(0);
+        } else if (removeCount > 0) {
+            agent->removeRange(previousIndex, removeCount);
+            adjustment -= removeCount;
+            removeCount = 0;
+        }
+
+        for (int adjustedIndex = qMin(index, destination) + adjustment; previousIndex < adjustedIndex;) {
+            int filterCount = 0;
+            for (int i; (i = previousIndex + filterCount) < adjustedIndex; ++filterCount) {
+                if (agent->filterValue(cache.at(i)))
+                    break;
+            }
+            if (filterCount > 0) {
+                agent->removeRange(previousIndex, filterCount);
+                adjustedIndex -= filterCount;
+                adjustment -= filterCount;
+            } else {
+                ++previousIndex;
+            }
+        }
+
+        return adjustment + agent->moveRange(index + adjustment, count, destination + adjustment);
+    }
+
     int removeRange(int index, int count)
     {
         int adjustedIndex = index;
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+// Measures the cache against a synthetic address book of production scale.
+//
+// Each address book size is measured in a separate process so that peak memory usage is
+// attributable to that size alone.  Results are written to stdout as one JSON object per
+// line.
+//
+// Usage: bench_seasidecache [--sizes 1000,10000,50000,100000]
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+#include <QTextStream>
+#include <QTimer>
+#include <QtDebug>
+
+#include <QContactEmailAddress>
+#include <QContactFavorite>
+#include <QContactManager>
+#include <QContactName>
+#include <QContactOrganization>
+#include <QContactPhoneNumber>
+#include <QContactPresence>
+
+#include "seasidecache.h"
+#include "seasidefilteredmodel.h"
+
+#include <algorithm>
+
+USE_CONTACTS_NAMESPACE
+
+static const char * const firstNames[] = {
+    "Aino", "Aleksi", "Anna", "Antti", "Elina", "Emilia", "Emma", "Eveliina", "Hanna", "Heikki",
+    "Helmi", "Ilkka", "Jari", "Johanna", "Juha", "Jukka", "Kaisa", "Kalle", "Katja", "Laura",
+    "Leena", "Marja", "Markku", "Matti", "Mika", "Mikko", "Minna", "Niina", "Olli", "Pekka",
+    "Petri", "Riikka", "Sami", "Sanna", "Sari", "Satu", "Teemu", "Tiina", "Timo", "Tuomas",
+    "Ville", "Andrew", "Chris", "David", "Maria", "Michael", "Sarah", "Zhang", "Wei", "Yuki"
+};
+
+static const char * const lastNames[] = {
+    "Korhonen", "Virtanen", "Mäkinen", "Nieminen", "Mäkelä", "Hämäläinen", "Laine", "Heikkinen",
+    "Koskinen", "Järvinen", "Lehtonen", "Lehtinen", "Saarinen", "Salminen", "Heinonen", "Niemi",
+    "Heikkilä", "Kinnunen", "Salonen", "Turunen", "Salo", "Laitinen", "Tuominen", "Rantanen",
+    "Karjalainen", "Jokinen", "Mattila", "Savolainen", "Lahtinen", "Ahonen", "Smith", "Jones",
+    "Brown", "Taylor", "Wilson", "Müller", "Schmidt", "García", "Martínez", "Li"
+};
+
+static const char * const companies[] = {
+    "Jolla", "Acme", "Globex", "Initech", "Umbrella", "Hooli", "Vandelay", "Stark", "Wayne",
+    "Tyrell"
+};
+
+static const char * const domains[] = {
+    "example.com", "example.org", "mail.example.net", "corp.example.com", "uni.example.edu"
+};
+
+template <typename T, int N>
+static int arraySize(T (&)[N])
+{
+    return N;
+}
+
+// A small deterministic generator, so that every run measures the same address book.
+class Random
+{
+public:
+    Random() : m_state(0x2545f491) {}
+
+    quint32 next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    // Uniform value in [0, count).
+    int uniform(int count) { return next() % count; }
+
+    // Skewed towards low values, approximating the frequency distribution of real names.
+    int skewed(int count)
+    {
+        const qreal r = qreal(next() % 10000) / 10000;
+        return qMin(count - 1, int(r * r * count));
+    }
+
+    bool chance(int percent) { return uniform(100) < percent; }
+
+private:
+    quint32 m_state;
+};
+
+static QString phoneNumber(quint32 value)
+{
+    return QString::fromLatin1("+35840%1").arg(value % 10000000, 7, 10, QLatin1Char('0'));
+}
+
+static QList<QContact> generateContacts(int count, QStringList *phoneNumbers)
+{
+    Random random;
+
+    QList<QContact> contacts;
+    contacts.reserve(count);
+
+    for (int i = 0; i < count; ++i) {
+        QContact contact;
+
+        QContactName name;
+        name.setFirstName(QString::fromUtf8(firstNames[random.skewed(arraySize(firstNames))]));
+        name.setLastName(QString::fromUtf8(lastNames[random.skewed(arraySize(lastNames))]));
+        contact.saveDetail(&name);
+
+        const int numberCount = 1 + random.skewed(3);
+        for (int j = 0; j < numberCount; ++j) {
+            QContactPhoneNumber number;
+            number.setNumber(phoneNumber(random.next()));
+            contact.saveDetail(&number);
+            phoneNumbers->append(number.number());
+        }
+
+        if (random.chance(40)) {
+            QContactEmailAddress email;
+            email.setEmailAddress(name.firstName().toLower() + QLatin1Char('.') + name.lastName().toLower()
+                    + QLatin1Char('@') + QString::fromLatin1(domains[random.skewed(arraySize(domains))]));
+            contact.saveDetail(&email);
+        }
+
+        if (random.chance(25)) {
+            QContactOrganization organization;
+            organization.setName(QString::fromLatin1(companies[random.skewed(arraySize(companies))]));
+            contact.saveDetail(&organization);
+        }
+
+        if (random.chance(5)) {
+            QContactFavorite favorite;
+            favorite.setFavorite(true);
+            contact.saveDetail(&favorite);
+        }
+
+        if (random.chance(30)) {
+            QContactPresence presence;
+            presence.setPresenceState(random.chance(60)
+                    ? QContactPresence::PresenceAvailable
+                    : QContactPresence::PresenceAway);
+            presence.setNickname(name.firstName());
+            contact.saveDetail(&presence);
+        }
+
+        contacts.append(contact);
+    }
+
+    return contacts;
+}
+
+static bool saveContacts(QContactManager *manager, QList<QContact> contacts)
+{
+    static const int BatchSize = 500;
+
+    for (int i = 0; i < contacts.count(); i += BatchSize) {
+        QList<QContact> batch = contacts.mid(i, BatchSize);
+        if (!manager->saveContacts(&batch, 0)) {
+            qWarning() << "Unable to save contacts:" << manager->error();
+            return false;
+        }
+    }
+    return true;
+}
+
+static qint64 peakResidentKb()
+{
+    QFile status(QString::fromLatin1("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    foreach (const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+static bool removePath(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QFileInfo &info, dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden)) {
+        if (info.isDir() && !info.isSymLink()) {
+            removePath(info.absoluteFilePath());
+        } else {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+    return dir.rmdir(path);
+}
+
+class Results
+{
+public:
+    void add(const char *name, qint64 value)
+    {
+        m_fields.append(QString::fromLatin1("\"%1\": %2").arg(QLatin1String(name)).arg(value));
+    }
+
+    void add(const char *name, double value)
+    {
+        m_fields.append(QString::fromLatin1("\"%1\": %2").arg(QLatin1String(name)).arg(value, 0, 'f', 3));
+    }
+
+    QString toJson() const
+    {
+        return QLatin1Char('{') + m_fields.join(QLatin1String(", ")) + QLatin1Char('}');
+    }
+
+private:
+    QStringList m_fields;
+};
+
+static double median(QList<double> values)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(values.count() / 2);
+}
+
+static int measure(int count)
+{
+    // Keep the backend and snapshots of other processes out of the measurement.
+    const QString dataPath = QDir::tempPath()
+            + QString::fromLatin1("/bench_seasidecache-%1").arg(QCoreApplication::applicationPid());
+    QDir().mkpath(dataPath);
+    qputenv("XDG_DATA_HOME", QFile::encodeName(dataPath + QLatin1String("/data")));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(dataPath + QLatin1String("/cache")));
+
+    // The contacts are saved to a private qtcontacts-sqlite database, which the cache reads
+    // in the same process.
+    qputenv("NEMO_CONTACT_MANAGER", "org.nemomobile.contacts.sqlite");
+
+    Results results;
+    results.add("contacts", qint64(count));
+
+    QStringList phoneNumbers;
+    const QList<QContact> contacts = generateContacts(count, &phoneNumbers);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QContactManager manager(QString::fromLatin1("org.nemomobile.contacts.sqlite"));
+    if (!saveContacts(&manager, contacts)) {
+        removePath(dataPath);
+        return 1;
+    }
+    results.add("saveMs", timer.elapsed());
+
+    // Time to populated for each list, measured from the creation of the cache.
+    static const int PopulationTimeoutMs = 10 * 60 * 1000;
+
+    const SeasideFilteredModel::FilterType filters[] = {
+        SeasideFilteredModel::FilterFavorites,
+        SeasideFilteredModel::FilterAll,
+        SeasideFilteredModel::FilterOnline
+    };
+    const char * const populatedNames[] = {
+        "populatedFavoritesMs",
+        "populatedAllMs",
+        "populatedOnlineMs"
+    };
+    const int filterCount = arraySize(filters);
+
+    timer.restart();
+
+    QList<SeasideFilteredModel *> models;
+    QList<qint64> populated;
+    for (int i = 0; i < filterCount; ++i) {
+        SeasideFilteredModel *model = new SeasideFilteredModel;
+        model->setFilterType(filters[i]);
+        models.append(model);
+        populated.append(-1);
+    }
+
+    // Wake periodically so that the timeout is honored even if population stalls.
+    QTimer wakeup;
+    wakeup.start(50);
+
+    for (int remaining = filterCount; remaining > 0 && timer.elapsed() < PopulationTimeoutMs;) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+        for (int i = 0; i < filterCount; ++i) {
+            if (populated.at(i) < 0 && models.at(i)->isPopulated()) {
+                populated[i] = timer.elapsed();
+                --remaining;
+            }
+        }
+    }
+
+    wakeup.stop();
+
+    for (int i = 0; i < filterCount; ++i)
+        results.add(populatedNames[i], populated.at(i));
+
+    SeasideFilteredModel *allModel = models.at(1);
+    results.add("rows", qint64(allModel->rowCount()));
+
+    // Latency of each keystroke while typing and then deleting a search.
+    const QString pattern = QString::fromLatin1("mikko ko");
+    QList<double> keystrokes;
+    for (int i = 1; i <= pattern.length(); ++i) {
+        timer.restart();
+        allModel->setFilterPattern(pattern.left(i));
+        keystrokes.append(double(timer.nsecsElapsed()) / 1000000);
+    }
+    results.add("searchMatches", qint64(allModel->rowCount()));
+    for (int i = pattern.length() - 1; i >= 0; --i) {
+        timer.restart();
+        allModel->setFilterPattern(pattern.left(i));
+        keystrokes.append(double(timer.nsecsElapsed()) / 1000000);
+    }
+    results.add("searchKeystrokeMedianMs", median(keystrokes));
+    results.add("searchKeystrokeMaxMs", *std::max_element(keystrokes.begin(), keystrokes.end()));
+
+    // Caller ID lookups, for numbers known to the address book and unknown numbers.
+    static const int LookupCount = 1000;
+
+    Random random;
+    QStringList knownNumbers;
+    QStringList unknownNumbers;
+    for (int i = 0; i < LookupCount; ++i) {
+        knownNumbers.append(phoneNumbers.at(random.uniform(phoneNumbers.count())));
+        unknownNumbers.append(QString::fromLatin1("+1555%1").arg(i, 7, 10, QLatin1Char('0')));
+    }
+
+    int resolved = 0;
+    timer.restart();
+    foreach (const QString &number, knownNumbers)
+        resolved += allModel->personByPhoneNumber(number) ? 1 : 0;
+    results.add("phoneLookupKnownUs", double(timer.nsecsElapsed()) / 1000 / LookupCount);
+    results.add("phoneLookupResolved", qint64(resolved));
+
+    timer.restart();
+    foreach (const QString &number, unknownNumbers)
+        allModel->personByPhoneNumber(number);
+    results.add("phoneLookupUnknownUs", double(timer.nsecsElapsed()) / 1000 / LookupCount);
+
+    results.add("peakRssKb", peakResidentKb());
+
+    QTextStream(stdout) << results.toJson() << endl;
+
+    qDeleteAll(models);
+    removePath(dataPath);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments = app.arguments();
+    arguments.removeFirst();
+
+    QList<int> sizes;
+    sizes << 1000 << 10000 << 50000 << 100000;
+
+    for (int i = 0; i + 1 < arguments.count(); i += 2) {
+        if (arguments.at(i) == QLatin1String("--contacts")) {
+            return measure(arguments.at(i + 1).toInt());
+        } else if (arguments.at(i) == QLatin1String("--sizes")) {
+            sizes.clear();
+            foreach (const QString &size, arguments.at(i + 1).split(QLatin1Char(',')))
+                sizes.append(size.toInt());
+        }
+    }
+
+    int result = 0;
+    foreach (int size, sizes) {
+        QProcess process;
+        process.setProcessChannelMode(QProcess::ForwardedChannels);
+        process.start(app.applicationFilePath(), QStringList()
+                << QString::fromLatin1("--contacts") << QString::number(size));
+        if (!process.waitForFinished(-1) || process.exitCode() != 0) {
+            qWarning() << "Benchmark failed for" << size << "contacts";
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = bench_seasidecache
+
+SOURCES += bench_seasidecache.cpp
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Measures synchronizeList() and synchronizeFilteredList() on lists of 1k to 100k items, for
+// the edits the cache sees in practice.  Alongside the time of each, the callbacks made to the
+// agent are reported, as those determine the model signals emitted.
+
+#include <QObject>
+#include <QtTest>
+
+#include "synchronizelists_p.h"
+
+#include <algorithm>
+
+class bench_SynchronizeLists : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum EditPattern {
+        ScatteredEdits,
+        BlockInsert,
+        TailTruncation,
+        Reversal,
+        IncrementalDelivery
+    };
+
+    bench_SynchronizeLists();
+
+    bool m_filterEnabled;
+    QVector<quint32> m_cache;
+    int m_insertCalls;
+    int m_removeCalls;
+    int m_moveCalls;
+
+    bool filterValue(quint32 contactId) const;
+    int insertRange(int index, int count, const QVector<quint32> &source, int sourceIndex);
+    int removeRange(int index, int count);
+    int moveRange(int index, int count, int destination);
+
+private slots:
+    void unfiltered_data();
+    void unfiltered();
+    void filtered_data();
+    void filtered();
+
+private:
+    void addRows();
+    void synchronize(const QVector<quint32> &reference, int chunkSize);
+    void reportCallbacks();
+};
+
+typedef QVector<quint32> List;
+
+Q_DECLARE_METATYPE(List)
+
+// The reference lists are delivered in chunks of this size by the IncrementalDelivery pattern,
+// as the backend reports the results of a query progressively.
+static const int ChunkSize = 500;
+
+static List sequence(int count)
+{
+    List list;
+    list.reserve(count);
+    for (int i = 0; i < count; ++i)
+        list.append(i);
+    return list;
+}
+
+// The reference list is 0..size-1; the original cache list is that edited so that the reference
+// list undoes the edit.
+static List originalList(bench_SynchronizeLists::EditPattern pattern, int size)
+{
+    List list = sequence(size);
+
+    switch (pattern) {
+    case bench_SynchronizeLists::ScatteredEdits:
+    case bench_SynchronizeLists::IncrementalDelivery:
+        // One item in a hundred removed, added or renamed to a new position.
+        for (int i = 50; i + 100 < list.count(); i += 100) {
+            switch ((i / 100) % 3) {
+            case 0:
+                list.remove(i);
+                break;
+            case 1:
+                list.insert(i, size + i);
+                break;
+            default:
+                std::swap(list[i], list[i + 50]);
+                break;
+            }
+        }
+        break;
+    case bench_SynchronizeLists::BlockInsert:
+        // A tenth of the list, such as an imported account, inserted in the middle.
+        list.remove(size / 2, size / 10);
+        break;
+    case bench_SynchronizeLists::TailTruncation:
+        // The last tenth of the list removed.
+        for (int i = size; i < size + size / 9; ++i)
+            list.append(i);
+        break;
+    case bench_SynchronizeLists::Reversal:
+        // The whole list reordered, as when the display label order changes.
+        std::reverse(list.begin(), list.end());
+        break;
+    }
+
+    return list;
+}
+
+bench_SynchronizeLists::bench_SynchronizeLists()
+    : m_filterEnabled(false)
+    , m_insertCalls(0)
+    , m_removeCalls(0)
+    , m_moveCalls(0)
+{
+    qRegisterMetaType<List>();
+}
+
+bool bench_SynchronizeLists::filterValue(quint32 contactId) const
+{
+    // Interleaves rejected items with those accepted.
+    return !m_filterEnabled || contactId % 3 != 0;
+}
+
+int bench_SynchronizeLists::insertRange(
+        int index, int count, const QVector<quint32> &source, int sourceIndex)
+{
+    ++m_insertCalls;
+
+    m_cache.insert(index, count, 0);
+    std::copy(source.constBegin() + sourceIndex, source.constBegin() + sourceIndex + count, m_cache.begin() + index);
+
+    return count;
+}
+
+int bench_SynchronizeLists::removeRange(int index, int count)
+{
+    ++m_removeCalls;
+
+    m_cache.remove(index, count);
+
+    return 0;
+}
+
+int bench_SynchronizeLists::moveRange(int index, int count, int destination)
+{
+    ++m_moveCalls;
+
+    const QVector<quint32> items = m_cache.mid(index, count);
+    m_cache.remove(index, count);
+
+    const int to = destination > index ? destination - count : destination;
+    m_cache.insert(to, count, 0);
+    std::copy(items.constBegin(), items.constEnd(), m_cache.begin() + to);
+
+    return destination < index ? count : 0;
+}
+
+void bench_SynchronizeLists::addRows()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("pattern");
+
+    static const int sizes[] = { 1000, 10000, 100000 };
+    static const char * const patternNames[] = {
+        "scattered", "block", "truncation", "reversal", "incremental"
+    };
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (int pattern = ScatteredEdits; pattern <= IncrementalDelivery; ++pattern) {
+            const QByteArray name = QByteArray(patternNames[pattern]) + '-' + QByteArray::number(sizes[s]);
+            QTest::newRow(name.constData()) << sizes[s] << pattern;
+        }
+    }
+}
+
+void bench_SynchronizeLists::synchronize(const List &reference, int chunkSize)
+{
+    int c = 0;
+    int r = 0;
+
+    // The unfiltered list retains its state between deliveries, as the cache does.
+    SynchronizeListState<quint32> state;
+
+    List delivered;
+    delivered.reserve(reference.count());
+    while (delivered.count() < reference.count()) {
+        const int end = qMin(delivered.count() + chunkSize, reference.count());
+        for (int i = delivered.count(); i < end; ++i)
+            delivered.append(reference.at(i));
+
+        if (m_filterEnabled)
+            synchronizeFilteredList(this, m_cache, c, delivered, r);
+        else
+            synchronizeList(this, m_cache, c, delivered, r, state);
+    }
+
+    if (c < m_cache.count())
+        removeRange(c, m_cache.count() - c);
+
+    List remaining;
+    for (; r < reference.count(); ++r) {
+        if (filterValue(reference.at(r)))
+            remaining.append(reference.at(r));
+    }
+    if (!remaining.isEmpty())
+        insertRange(m_cache.count(), remaining.count(), remaining, 0);
+}
+
+void bench_SynchronizeLists::reportCallbacks()
+{
+    qDebug("callbacks: %d inserts, %d removes, %d moves", m_insertCalls, m_removeCalls, m_moveCalls);
+}
+
+void bench_SynchronizeLists::unfiltered_data()
+{
+    addRows();
+}
+
+void bench_SynchronizeLists::unfiltered()
+{
+    QFETCH(int, size);
+    QFETCH(int, pattern);
+
+    m_filterEnabled = false;
+
+    const List reference = sequence(size);
+    const List original = originalList(EditPattern(pattern), size);
+    const int chunkSize = pattern == IncrementalDelivery ? ChunkSize : size;
+
+    QBENCHMARK {
+        m_cache = original;
+        m_insertCalls = 0;
+        m_removeCalls = 0;
+        m_moveCalls = 0;
+
+        synchronize(reference, chunkSize);
+    }
+
+    QCOMPARE(m_cache, reference);
+    reportCallbacks();
+}
+
+void bench_SynchronizeLists::filtered_data()
+{
+    addRows();
+}
+
+void bench_SynchronizeLists::filtered()
+{
+    QFETCH(int, size);
+    QFETCH(int, pattern);
+
+    m_filterEnabled = true;
+
+    const List reference = sequence(size);
+    const List original = originalList(EditPattern(pattern), size);
+    const int chunkSize = pattern == IncrementalDelivery ? ChunkSize : size;
+
+    // The cached list holds only the items accepted by the filter, as the filtered model does.
+    List filteredOriginal;
+    List expected;
+    foreach (quint32 contactId, original) {
+        if (filterValue(contactId))
+            filteredOriginal.append(contactId);
+    }
+    foreach (quint32 contactId, reference) {
+        if (filterValue(contactId))
+            expected.append(contactId);
+    }
+
+    QBENCHMARK {
+        m_cache = filteredOriginal;
+        m_insertCalls = 0;
+        m_removeCalls = 0;
+        m_moveCalls = 0;
+
+        synchronize(reference, chunkSize);
+    }
+
+    QCOMPARE(m_cache, expected);
+    reportCallbacks();
+}
+
+#include "bench_synchronizelists.moc"
+QTEST_APPLESS_MAIN(bench_SynchronizeLists)
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = bench_synchronizelists
+
+SOURCES += bench_synchronizelists.cpp
@@ -2,7 +2,11 @@ TEMPLATE = subdirs
 SUBDIRS = \
           tst_seasideperson \
           tst_seasidefilteredmodel \
-          tst_synchronizelists
+          tst_synchronizelists \
+          tst_cacheitemtable \
+          tst_prefixindex \
+          bench_seasidecache \
+          bench_synchronizelists
 
 tests_xml.target = tests.xml
 tests_xml.files = tests.xml
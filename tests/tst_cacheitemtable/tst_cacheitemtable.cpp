@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+#include <QObject>
+#include <QtTest>
+
+#include "cacheitemtable_p.h"
+
+
+class tst_CacheItemTable : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void insertFind();
+    void erase();
+    void stablePointers();
+    void iterate();
+    void copy();
+};
+
+typedef CacheItemTable<QString> Table;
+
+void tst_CacheItemTable::insertFind()
+{
+    Table table;
+    QVERIFY(table.isEmpty());
+    QVERIFY(table.find(1) == table.end());
+
+    for (quint32 i = 1; i <= 1000; ++i)
+        table[i] = QString::number(i);
+    table.insert(0x80000000u, QLatin1String("high"));
+
+    QCOMPARE(table.count(), 1001);
+    for (quint32 i = 1; i <= 1000; ++i) {
+        Table::const_iterator it = table.constFind(i);
+        QVERIFY(it != table.constEnd());
+        QCOMPARE(it.key(), i);
+        QCOMPARE(*it, QString::number(i));
+    }
+    QCOMPARE(table[0x80000000u], QString(QLatin1String("high")));
+    QVERIFY(!table.contains(1001));
+    QVERIFY(table.contains(0x80000000u));
+
+    // Assigning to an existing key doesn't add an entry.
+    table[500] = QLatin1String("five hundred");
+    QCOMPARE(table.count(), 1001);
+    QCOMPARE(*table.find(500), QString(QLatin1String("five hundred")));
+}
+
+void tst_CacheItemTable::erase()
+{
+    Table table;
+    for (quint32 i = 1; i <= 1000; ++i)
+        table[i] = QString::number(i);
+
+    // Remove every third entry; the remaining entries must still be reachable.
+    for (quint32 i = 3; i <= 1000; i += 3)
+        table.erase(table.find(i));
+
+    QCOMPARE(table.count(), 1000 - 333);
+    for (quint32 i = 1; i <= 1000; ++i) {
+        if (i % 3 == 0) {
+            QVERIFY(!table.contains(i));
+        } else {
+            QCOMPARE(*table.find(i), QString::number(i));
+        }
+    }
+
+    QCOMPARE(table.remove(1), 1);
+    QCOMPARE(table.remove(1), 0);
+
+    // Reinserting an erased key yields a default constructed value.
+    QCOMPARE(table[3], QString());
+}
+
+void tst_CacheItemTable::stablePointers()
+{
+    Table table;
+    table[7] = QLatin1String("seven");
+    QString *seven = &table[7];
+
+    // Growing the table mustn't move existing items.
+    for (quint32 i = 100; i < 10000; ++i)
+        table[i] = QString::number(i);
+    for (quint32 i = 100; i < 5000; ++i)
+        table.remove(i);
+
+    QCOMPARE(&table[7], seven);
+    QCOMPARE(*seven, QString(QLatin1String("seven")));
+}
+
+void tst_CacheItemTable::iterate()
+{
+    Table table;
+    QSet<quint32> expected;
+    for (quint32 i = 0; i < 300; ++i) {
+        const quint32 key = i * 7919;
+        table[key] = QString::number(key);
+        expected.insert(key);
+    }
+    table.remove(0);
+    expected.remove(0);
+
+    QSet<quint32> actual;
+    for (Table::iterator it = table.begin(); it != table.end(); ++it) {
+        QCOMPARE(*it, QString::number(it.key()));
+        actual.insert(it.key());
+    }
+    QCOMPARE(actual, expected);
+}
+
+void tst_CacheItemTable::copy()
+{
+    Table table;
+    for (quint32 i = 1; i <= 100; ++i)
+        table[i] = QString::number(i);
+
+    Table other(table);
+    table.clear();
+    QVERIFY(table.isEmpty());
+    QVERIFY(table.begin() == table.end());
+
+    QCOMPARE(other.count(), 100);
+    for (quint32 i = 1; i <= 100; ++i)
+        QCOMPARE(*other.find(i), QString::number(i));
+
+    table = other;
+    QCOMPARE(table.count(), 100);
+    QCOMPARE(*table.find(50), QString::number(50));
+}
+
+#include "tst_cacheitemtable.moc"
+QTEST_APPLESS_MAIN(tst_CacheItemTable)
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_cacheitemtable
+
+SOURCES += tst_cacheitemtable.cpp
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2013 Jolla Mobile <andrew.den.exter@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+
+
+#include <QObject>
+#include <QtTest>
+
+#include "prefixindex_p.h"
+
+
+class tst_PrefixIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void match_data();
+    void match();
+    void remove();
+    void caseVariants();
+};
+
+typedef QSet<quint32> Set;
+
+Q_DECLARE_METATYPE(Set)
+
+static QStringList tokens(const char *words)
+{
+    return QString::fromLatin1(words).split(QLatin1Char(' '), QString::SkipEmptyParts);
+}
+
+static void populate(PrefixIndex *index)
+{
+    index->insert(1, tokens("Anna Smith anna@example.com"));
+    index->insert(2, tokens("Andrew Smithers"));
+    index->insert(3, tokens("Bob Jones 5551234"));
+    index->insert(4, tokens("Annabel Jonas"));
+}
+
+void tst_PrefixIndex::match_data()
+{
+    QTest::addColumn<QStringList>("prefixes");
+    QTest::addColumn<Set>("expected");
+
+    QTest::newRow("exact")
+            << tokens("bob")
+            << (Set() << 3);
+    QTest::newRow("prefix")
+            << tokens("an")
+            << (Set() << 1 << 2 << 4);
+    QTest::newRow("longer prefix")
+            << tokens("anna")
+            << (Set() << 1 << 4);
+    QTest::newRow("case")
+            << tokens("SMITH")
+            << (Set() << 1 << 2);
+    QTest::newRow("every prefix")
+            << tokens("an smith")
+            << (Set() << 1 << 2);
+    QTest::newRow("order")
+            << tokens("jon ann")
+            << (Set() << 4);
+    QTest::newRow("number")
+            << tokens("555")
+            << (Set() << 3);
+    QTest::newRow("no match")
+            << tokens("carol")
+            << Set();
+    QTest::newRow("one prefix unmatched")
+            << tokens("anna carol")
+            << Set();
+    QTest::newRow("past last token")
+            << tokens("z")
+            << Set();
+}
+
+void tst_PrefixIndex::match()
+{
+    QFETCH(QStringList, prefixes);
+    QFETCH(Set, expected);
+
+    PrefixIndex index;
+    populate(&index);
+
+    QCOMPARE(index.match(prefixes), expected);
+}
+
+void tst_PrefixIndex::remove()
+{
+    PrefixIndex index;
+    populate(&index);
+
+    const int count = index.count();
+    QVERIFY(index.size() > 0);
+
+    // Removing a contact leaves tokens still held by others.
+    index.remove(1, tokens("Anna Smith anna@example.com"));
+    QCOMPARE(index.match(tokens("anna")), Set() << 4);
+    QCOMPARE(index.match(tokens("smith")), Set() << 2);
+    QCOMPARE(index.count(), count - 3);
+
+    // Tokens the contact doesn't hold are ignored.
+    index.remove(2, tokens("Bob Carol"));
+    QCOMPARE(index.match(tokens("bob")), Set() << 3);
+
+    // A changed key is removed and inserted again.
+    index.remove(3, tokens("Bob Jones 5551234"));
+    index.insert(3, tokens("Robert Jones 5551234"));
+    QCOMPARE(index.match(tokens("bob")), Set());
+    QCOMPARE(index.match(tokens("rob jones")), Set() << 3);
+
+    index.clear();
+    QCOMPARE(index.count(), 0);
+    QCOMPARE(index.size(), qint64(0));
+    QCOMPARE(index.match(tokens("a")), Set());
+}
+
+void tst_PrefixIndex::caseVariants()
+{
+    PrefixIndex index;
+
+    // Tokens differing only in case are indexed once.
+    index.insert(1, tokens("McDonald mcdonald"));
+    QCOMPARE(index.count(), 1);
+    QCOMPARE(index.match(tokens("MCD")), Set() << 1);
+
+    index.remove(1, tokens("McDonald mcdonald"));
+    QCOMPARE(index.count(), 0);
+    QCOMPARE(index.match(tokens("mcd")), Set());
+}
+
+#include "tst_prefixindex.moc"
+QTEST_APPLESS_MAIN(tst_PrefixIndex)
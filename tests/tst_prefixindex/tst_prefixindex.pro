@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_prefixindex
+
+SOURCES += tst_prefixindex.cpp
@@ -158,10 +158,18 @@ void SeasideCache::reset()
             contact.saveDetail(&email);
         }
 
+        SeasideCacheItem item(contact);
+        item.firstName = name.firstName();
+        item.lastName = name.lastName();
+        item.displayLabel = QLatin1String(contactsData[i].fullName);
+        if (contactsData[i].avatar)
+            item.avatarUrl = QUrl(QLatin1String(contactsData[i].avatar));
+        item.filterKey = SeasideFilteredModel::filterKey(contact);
+
 #ifdef USING_QTPIM
         m_cacheIndices.insert(SeasideFilteredModel::apiId(contact), m_cache.count());
 #endif
-        m_cache.append(SeasideCacheItem(contact));
+        m_cache.append(item);
     }
 
     insert(SeasideFilteredModel::FilterAll, 0, getContactsForFilterType(SeasideFilteredModel::FilterAll));
@@ -234,6 +242,11 @@ SeasideCacheItem *SeasideCache::cacheItemById(const ContactIdType &id)
     return 0;
 }
 
+SeasideCacheItem *SeasideCache::displayedItemById(const ContactIdType &id)
+{
+    return cacheItemById(id);
+}
+
 SeasidePerson *SeasideCache::personById(const ContactIdType &id)
 {
 #ifdef USING_QTPIM
@@ -365,6 +378,31 @@ bool SeasideCache::isPopulated(SeasideFilteredModel::FilterType filterType)
     return instance->m_populated[filterType];
 }
 
+bool SeasideCache::matchContacts(
+        SeasideFilteredModel::FilterType filterType,
+        const QStringList &prefixes,
+        QVector<ContactIdType> *contactIds)
+{
+    // There is no index, but the contacts matched are those it would find.
+    contactIds->clear();
+    foreach (const ContactIdType &contactId, instance->m_contacts[filterType]) {
+        SeasideCacheItem *item = cacheItemById(contactId);
+        if (!item)
+            continue;
+
+        bool match = true;
+        foreach (const QString &prefix, prefixes) {
+            bool found = false;
+            foreach (const QString &token, item->filterKey)
+                found = found || token.startsWith(prefix, Qt::CaseInsensitive);
+            match = match && found;
+        }
+        if (match)
+            contactIds->append(contactId);
+    }
+    return true;
+}
+
 SeasideFilteredModel::DisplayLabelOrder SeasideCache::displayLabelOrder()
 {
     return SeasideFilteredModel::FirstNameFirst;
@@ -427,7 +465,8 @@ void SeasideCache::setDisplayName(SeasideFilteredModel::FilterType filterType, i
 #endif
     cacheItem.contact.saveDetail(&name);
 
-    cacheItem.filterKey = QStringList();
+    cacheItem.displayLabel = displayName;
+    cacheItem.filterKey = SeasideFilteredModel::filterKey(cacheItem.contact);
 
     if (m_models[filterType])
         m_models[filterType]->sourceDataChanged(index, index);
@@ -2,6 +2,7 @@
 #define SEASIDECACHE_H
 
 #include <QContact>
+#include <QUrl>
 
 #include "seasidefilteredmodel.h"
 
@@ -10,6 +11,11 @@ struct SeasideCacheItem
     SeasideCacheItem() : person(0) {}
     SeasideCacheItem(const QContact &contact) : contact(contact), person(0) {}
 
+    QString firstName;
+    QString lastName;
+    QString displayLabel;
+    QUrl avatarUrl;
+
     QContact contact;
     SeasidePerson *person;
     QStringList filterKey;
@@ -35,6 +41,7 @@ public:
     static int contactId(const QContact &contact);
 
     static SeasideCacheItem *cacheItemById(const ContactIdType &id);
+    static SeasideCacheItem *displayedItemById(const ContactIdType &id);
     static SeasidePerson *personById(const ContactIdType &id);
 #ifdef USING_QTPIM
     static SeasidePerson *personById(int id);
@@ -54,6 +61,10 @@ public:
 
     static const QVector<ContactIdType> *contacts(SeasideFilteredModel::FilterType filterType);
     static bool isPopulated(SeasideFilteredModel::FilterType filterType);
+    static bool matchContacts(
+            SeasideFilteredModel::FilterType filterType,
+            const QStringList &prefixes,
+            QVector<ContactIdType> *contactIds);
 
     void populate(SeasideFilteredModel::FilterType filterType);
     void insert(SeasideFilteredModel::FilterType filterType, int index, const QVector<ContactIdType> &ids);
@@ -49,12 +49,15 @@ public:
     bool filterValue(quint32 contactId) const;
     int insertRange(int index, int count, const QVector<quint32> &source, int sourceIndex);
     int removeRange(int index, int count);
+    int moveRange(int index, int count, int destination);
 
 private slots:
     void filtered_data();
     void filtered();
     void unfiltered_data();
     void unfiltered();
+    void incremental_data();
+    void incremental();
 };
 
 typedef QVector<quint32> List;
@@ -88,6 +91,18 @@ int tst_SynchronizeLists::removeRange(int index, int count)
     return 0;
 }
 
+int tst_SynchronizeLists::moveRange(int index, int count, int destination)
+{
+    const QVector<quint32> items = m_cache.mid(index, count);
+    m_cache.remove(index, count);
+
+    const int to = destination > index ? destination - count : destination;
+    for (int i = 0; i < count; ++i)
+        m_cache.insert(to + i, items.at(i));
+
+    return destination < index ? count : 0;
+}
+
 void tst_SynchronizeLists::filtered_data()
 {
     QTest::addColumn<QVector<quint32> >("reference");
@@ -280,6 +295,21 @@ void tst_SynchronizeLists::unfiltered_data()
     QTest::newRow("6")
             << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
             << (List() << 10 << 9 << 8 << 7 << 6);
+    QTest::newRow("7")
+            << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
+            << (List() << 6 << 7 << 8 << 9 << 10 << 0 << 1 << 2 << 3 << 4 << 5);
+    QTest::newRow("8")
+            << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
+            << (List() << 1 << 0 << 3 << 2 << 11 << 5 << 4 << 7 << 6 << 12 << 9 << 8);
+    QTest::newRow("9")
+            << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
+            << (List() << 0 << 1 << 8 << 2 << 3 << 4 << 5 << 6 << 7 << 9 << 10);
+    QTest::newRow("10")
+            << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
+            << (List() << 0 << 1 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10 << 2);
+    QTest::newRow("11")
+            << (List() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10)
+            << (List() << 10 << 0 << 1 << 2 << 3 << 4 << 6 << 7 << 5 << 8 << 9);
 }
 
 void tst_SynchronizeLists::unfiltered()
@@ -308,5 +338,42 @@ void tst_SynchronizeLists::unfiltered()
     QCOMPARE(m_cache, reference);
 }
 
+void tst_SynchronizeLists::incremental_data()
+{
+    unfiltered_data();
+}
+
+void tst_SynchronizeLists::incremental()
+{
+    QFETCH(QVector<quint32>, reference);
+    QFETCH(QVector<quint32>, original);
+
+    m_filterEnabled = false;
+    m_cache = original;
+
+    int c = 0;
+    int r = 0;
+
+    // Deliver the reference list one item at a time, retaining the state between calls.
+    SynchronizeListState<quint32> state;
+    QVector<quint32> delivered;
+    for (int i = 0; i < reference.count(); ++i) {
+        delivered.append(reference.at(i));
+        synchronizeList(this, m_cache, c, delivered, r, state);
+    }
+
+    if (c < m_cache.count())
+        m_cache.remove(c, m_cache.count() - c);
+    for (; r < reference.count(); ++r)
+        m_cache.append(reference.at(r));
+
+    if (m_cache != reference) {
+        qDebug() << "expected" << reference;
+        qDebug() << "actual  " << m_cache;
+    }
+
+    QCOMPARE(m_cache, reference);
+}
+
 #include "tst_synchronizelists.moc"
 QTEST_APPLESS_MAIN(tst_SynchronizeLists)